@@ -0,0 +1,349 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/***************************************************************************
+ *   Solver convergence atlas: sweeps insolation, temperature and the      *
+ *   operating point over the envelope of each generator model, runs every *
+ *   solver at each point, and saves iteration counts, final residuals,    *
+ *   NaN results and time per call as Matlab v4 matrices, for heatmaps.    *
+ *                                                                         *
+ *   Temperatures are in Celsius, except for pvGenerator (KELVIN).         *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "arg_tool.h"
+#include "matv4.h"
+#include "error.h"
+#include "solver_stats.h"
+#include "pvgen_sc.h"
+#include "pvgen_mc.h"
+#include "pvgen_mpp_I.h"
+#include "pvgen_setup.h"
+
+#ifndef SOLVER_STATS
+#error "atlas reads iteration counts from the solver counters, build with -DSOLVER_STATS"
+#endif
+
+using namespace std;
+
+int iHelp, iOutFile, iGenerator, iThreads, iG0, iG1, iT0, iT1, iNG, iNT, iNX;
+int iShadedCells, iShade, iBypassCells;
+arg_t args[] = {
+	{"-h",                &iHelp,        ARG_FLAG},
+	{"--help",            &iHelp,        ARG_FLAG},
+	{"-o",                &iOutFile,     ARG_DEFAULT},
+	{"--generator-model", &iGenerator,   ARG_DEFAULT},
+	{"-j",                &iThreads,     ARG_DEFAULT},
+	{"--G0",              &iG0,          ARG_DEFAULT},
+	{"--G1",              &iG1,          ARG_DEFAULT},
+	{"--T0",              &iT0,          ARG_DEFAULT},
+	{"--T1",              &iT1,          ARG_DEFAULT},
+	{"-nG",               &iNG,          ARG_DEFAULT},
+	{"-nT",               &iNT,          ARG_DEFAULT},
+	{"-nX",               &iNX,          ARG_DEFAULT},
+	{"--shaded-cells",    &iShadedCells, ARG_DEFAULT},
+	{"--shade",           &iShade,       ARG_DEFAULT},
+	{"--bypass-cells",    &iBypassCells, ARG_DEFAULT},
+	{0,0,0}
+};
+
+// Operating point axis, as a fraction of the source current for V(I)
+// solvers, and of the nameplate Voc for I(V) ones. Past 1 for the reverse
+// region and for Voc on cold days.
+static const double xMax = 1.2;
+
+// Exposes the objective function, for residuals.
+struct atlas_sc : public pvGenerator_sc {
+	double residual(double V, double I) const { return f(curmdl, V, I); }
+};
+
+enum atlas_solver { ATLAS_V, ATLAS_I, ATLAS_MC_I, ATLAS_MPP, ATLAS_COUNT };
+static const char *atlas_name[ATLAS_COUNT] = { "V", "I", "mc_I", "mpp" };
+static const int atlas_id[ATLAS_COUNT] = {
+	SOLVER_PVGEN_V, SOLVER_PVGEN_I, SOLVER_PVGEN_MC_I, SOLVER_MPP_I
+};
+
+// Results of one solver on one model. Points are stored row major, rows
+// are (G,T) pairs, G first, columns the operating points; mpp has one
+// column, and is saved as a T by G matrix.
+struct atlas_map {
+	int cols;
+	vector<double> it, res, nan, ns, fail;
+	void resize(int rows, int c) {
+		cols = c;
+		it.assign(rows*c, 0);
+		res.assign(rows*c, 0);
+		nan.assign(rows*c, 0);
+		ns.assign(rows*c, 0);
+		fail.assign(rows*c, 0);
+	}
+};
+
+struct atlas_model {
+	const pvGenerator::parameters_t *param;
+	int shaded, bypass;
+	atlas_map map[ATLAS_COUNT];
+};
+
+static vector<atlas_model> models;
+static vector<double> sG, sT, sX;
+static double shade;
+static double ns_per_cycle;
+static std::atomic<int> next_row;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+// Stores the last call of solver s at point k of map, which returned r
+// with residual res. Reads the counters before any other call of s.
+static void record(atlas_map &map, int s, int k, double r, double res) {
+	solver_sample l = solver_last(atlas_id[s]);
+	map.it[k]   = l.iterations;
+	map.ns[k]   = l.cycles * ns_per_cycle;
+	map.fail[k] = !l.converged;
+	map.nan[k]  = std::isnan(r);
+	map.res[k]  = std::isnan(r) ? NAN : fabs(res);
+}
+
+// One (G,T) pair of one model, every solver.
+static void sweep(atlas_model &m, int row) {
+	int nG = sG.size();
+	double G = sG[row % nG], TK = sT[row / nG] + 273.16;
+	double Voc = m.param->nameplate.Voc;
+	
+	atlas_sc sc;
+	pvgen_setup(sc, m.param->model);
+	sc.setInsolation(G);
+	sc.setTemperature(TK);
+	double Iph = sc.getSourceCurrent();
+	
+	pvGenerator_mc mc;
+	pvgen_setup(mc, m.param->model);
+	mc.setBypass(m.bypass);
+	mc.setInsolation(G);
+	mc.setTemperature(TK);
+	for (int c=0; c<m.shaded; ++c) mc.setInsolation(c, G*shade);
+	
+	for (size_t j=0; j<sX.size(); ++j) {
+		int k = row*sX.size() + j;
+		
+		double I = sX[j]*Iph;
+		double V = sc.V(I);
+		record(m.map[ATLAS_V], ATLAS_V, k, V, sc.residual(V, I));
+		
+		V = sX[j]*Voc;
+		I = sc.I(V);
+		record(m.map[ATLAS_I], ATLAS_I, k, I, sc.residual(V, I));
+		
+		try {
+			I = mc.I(V);
+		} catch (error &e) {
+			I = NAN;
+		}
+		record(m.map[ATLAS_MC_I], ATLAS_MC_I, k, I, std::isnan(I) ? NAN : mc.V(I) - V);
+	}
+	
+	// MPP, residual is the slope of P(I) there
+	double Imp = pvgen_mpp_I(sc, 0, Iph, 1e-6);
+	double h = 1e-4*Iph;
+	double dP = ((Imp+h)*sc.V(Imp+h) - (Imp-h)*sc.V(Imp-h)) / (2*h);
+	record(m.map[ATLAS_MPP], ATLAS_MPP, row, Imp, dP);
+}
+
+static void *worker(void *) {
+	int rows = sG.size()*sT.size();
+	for (int i; (i = next_row++) < int(models.size())*rows; ) sweep(models[i/rows], i%rows);
+	return 0;
+}
+
+// Worst cases of one map, on stdout.
+static void summary(const atlas_map &map, const char *name) {
+	long n = map.it.size(), nnan = 0, nfail = 0;
+	double itsum = 0, nssum = 0, resmax = 0;
+	int worst = 0;
+	for (long k=0; k<n; ++k) {
+		nnan  += map.nan[k] != 0;
+		nfail += map.fail[k] != 0;
+		itsum += map.it[k];
+		nssum += map.ns[k];
+		if (map.it[k] > map.it[worst]) worst = k;
+		if (map.res[k] > resmax) resmax = map.res[k];
+	}
+	int row = worst / map.cols, nG = sG.size();
+	cout<<"  "<<setiosflags(ios::left)<<setw(6)<<name<<resetiosflags(ios::left);
+	cout<<setw(9)<<n<<setw(8)<<nnan<<setw(8)<<nfail;
+	cout<<setw(10)<<setprecision(3)<<itsum/n<<setw(7)<<int(map.it[worst]);
+	cout<<setw(10)<<setprecision(3)<<resmax<<setw(12)<<fixed<<setprecision(0)<<nssum/n;
+	cout<<defaultfloat<<"   G="<<setprecision(4)<<sG[row % nG]<<" T="<<sT[row / nG];
+	if (map.cols > 1) cout<<" x="<<sX[worst % map.cols];
+	cout<<endl;
+}
+
+// name_solver_what, as a rows x cols matrix.
+static void save(ostream &out, const string &name, const vector<double> &v, int cols) {
+	int rows = v.size() / cols;
+	vector<const double *> p(rows);
+	for (int i=0; i<rows; ++i) p[i] = &v[i*cols];
+	matv4_add(out, name.c_str(), p.data(), rows, cols);
+}
+
+int main(int argc, const char *argv[]) {
+	if (arg_eval(argc, argv, args)) {
+		cerr<<"Error: Command line parsing failed."<<endl;
+		return 1;
+	}
+	if (iHelp) {
+		cout<<"Usage: atlas [-o FILE] [--generator-model NAME] [-j THREADS]"<<endl;
+		cout<<"             [--G0 W/m^2] [--G1 W/m^2] [--T0 C] [--T1 C] [-nG N] [-nT N] [-nX N]"<<endl;
+		cout<<"             [--shaded-cells N] [--shade FRACTION] [--bypass-cells N]"<<endl;
+		cout<<"Runs the generator solvers over a grid of insolation G, temperature T"<<endl;
+		cout<<"and operating point x, for every fitted model or the one given, and"<<endl;
+		cout<<"saves to FILE (atlas.mat) iteration counts, residuals, NaN results,"<<endl;
+		cout<<"failures to converge and ns per call, as MODEL_SOLVER_it, _res, _nan,"<<endl;
+		cout<<"_fail and _ns. Solvers are:"<<endl;
+		cout<<"  V     pvGenerator_sc::V at I = x*Iph, residual in A"<<endl;
+		cout<<"  I     pvGenerator_sc::I at V = x*Voc, residual in A"<<endl;
+		cout<<"  mc_I  pvGenerator_mc::I at V = x*Voc, shaded, residual in V"<<endl;
+		cout<<"  mpp   pvgen_mpp_I, residual is dP/dI at the result, in V"<<endl;
+		cout<<"Matrices have one row per (G,T) pair and one column per x, so"<<endl;
+		cout<<"reshape(M, nG, nT, nX) takes them to M(G,T,x); mpp ones are nT x nG."<<endl;
+		cout<<"Shading darkens the first --shaded-cells (Ns/4) cells to --shade (0.2)"<<endl;
+		cout<<"of G, with a bypass diode every --bypass-cells (Ns/2) cells."<<endl;
+		return 0;
+	}
+	
+	cout<<"<< Solver convergence atlas >>"<<endl;
+	
+	// Models, all of those with a fitted model by default
+	if (iGenerator) {
+		atlas_model m;
+		m.param = generator_by_name(argv[iGenerator]);
+		if (!m.param) {
+			cerr<<"Error: Unknown generator model \""<<argv[iGenerator]<<"\"."<<endl;
+			return 1;
+		}
+		models.push_back(m);
+	} else for (int i=0; i<GEN_COUNT; ++i) {
+		atlas_model m;
+		m.param = &generators[i];
+		if (m.param->model.Iph > 0) models.push_back(m);
+		else cout<<"Skipping "<<m.param->name<<", no fitted model."<<endl;
+	}
+	
+	// Grid
+	double G0 = iG0 ? atof(argv[iG0]) : 20;
+	double G1 = iG1 ? atof(argv[iG1]) : 1200;
+	double T0 = iT0 ? atof(argv[iT0]) : -20;
+	double T1 = iT1 ? atof(argv[iT1]) : 80;
+	int nG = iNG ? atoi(argv[iNG]) : 48;
+	int nT = iNT ? atoi(argv[iNT]) : 21;
+	int nX = iNX ? atoi(argv[iNX]) : 61;
+	if (nG < 2 || nT < 2 || nX < 2) {
+		cerr<<"Error: Grids need at least 2 points."<<endl;
+		return 1;
+	}
+	for (int i=0; i<nG; ++i) sG.push_back(G0 + (G1-G0)*i/(nG-1));
+	for (int i=0; i<nT; ++i) sT.push_back(T0 + (T1-T0)*i/(nT-1));
+	for (int i=0; i<nX; ++i) sX.push_back(xMax*i/(nX-1));
+	
+	shade = iShade ? atof(argv[iShade]) : 0.2;
+	int rows = nG*nT;
+	for (size_t m=0; m<models.size(); ++m) {
+		for (int s=0; s<ATLAS_COUNT; ++s) models[m].map[s].resize(rows, s == ATLAS_MPP ? 1 : nX);
+	}
+	ns_per_cycle = 1e9/cpu_clock();
+	
+	int nthreads = iThreads ? atoi(argv[iThreads]) : sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1) nthreads = 1;
+	cout<<"G = "<<G0<<".."<<G1<<" W/m^2 ("<<nG<<"), T = "<<T0<<".."<<T1<<" C ("<<nT<<"), ";
+	cout<<"x = 0.."<<xMax<<" ("<<nX<<")"<<endl;
+	
+	for (size_t m=0; m<models.size(); ++m) {
+		atlas_model &a = models[m];
+		int Ns = a.param->model.Ns;
+		a.shaded = iShadedCells ? atoi(argv[iShadedCells]) : Ns/4;
+		a.bypass = iBypassCells ? atoi(argv[iBypassCells]) : Ns/2;
+		if (a.shaded < 0 || a.shaded > Ns || a.bypass < 0) {
+			cerr<<"Error: Invalid shading setup."<<endl;
+			return 1;
+		}
+	}
+	
+	cout<<"Sweeping "<<models.size()*rows*(3*nX+1)<<" solver calls on "<<nthreads<<" threads... "<<flush;
+	double t0 = now();
+	next_row = 0;
+	vector<pthread_t> tid(nthreads);
+	for (int i=0; i<nthreads; ++i) {
+		if (pthread_create(&tid[i], 0, worker, 0)) {
+			nthreads = i;
+			break;
+		}
+	}
+	if (nthreads == 0) worker(0);
+	for (int i=0; i<nthreads; ++i) pthread_join(tid[i], 0);
+	cout<<"Ok, "<<setprecision(3)<<now()-t0<<" s."<<endl;
+	
+	const char *file = iOutFile ? argv[iOutFile] : "atlas.mat";
+	ofstream out(file, ios::out|ios::binary|ios::trunc);
+	if (!out) {
+		cerr<<"Error: Can not write to \""<<file<<"\"."<<endl;
+		return 1;
+	}
+	matv4_add(out, "G", sG);
+	matv4_add(out, "T", sT);
+	matv4_add(out, "x", sX);
+	
+	for (size_t m=0; m<models.size(); ++m) {
+		const char *name = models[m].param->name;
+		cout<<endl<<name<<", "<<models[m].shaded<<" cells shaded to "<<shade<<" G, bypass every "<<models[m].bypass<<":"<<endl;
+		cout<<"  solver  points     NaN  failed  mean it  max it   max res     ns/call   at max it"<<endl;
+		for (int s=0; s<ATLAS_COUNT; ++s) {
+			const atlas_map &map = models[m].map[s];
+			summary(map, atlas_name[s]);
+			
+			string base = string(name) + "_" + atlas_name[s];
+			int cols = s == ATLAS_MPP ? nG : map.cols;
+			save(out, base + "_it",   map.it,   cols);
+			save(out, base + "_res",  map.res,  cols);
+			save(out, base + "_nan",  map.nan,  cols);
+			save(out, base + "_fail", map.fail, cols);
+			save(out, base + "_ns",   map.ns,   cols);
+		}
+	}
+	cout<<endl<<"Saved to "<<file<<"."<<endl;
+	
+	return 0;
+}
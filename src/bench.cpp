@@ -0,0 +1,403 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/***************************************************************************
+ *   Microbenchmarks: PV generator solvers, MPP search, map lookup,        *
+ *   trackers and file and serial formatting, in ns and TSC cycles per     *
+ *   operation. Inputs are fixed, so runs of different builds compare.     *
+ *                                                                         *
+ *   Temperatures are in Celsius, except for pvGenerator (KELVIN).         *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <time.h>
+#include "arg_tool.h"
+#include "straux.h"
+#include "rdtsc.h"
+#include "load_dat.h"
+#include "save_dat.h"
+#include "matv4.h"
+#include "kepco.h"
+#include "bilinear.h"
+#include "pvgen_sc.h"
+#include "pvgen_mc.h"
+#include "pvgen_mpp_I.h"
+#include "pvgen_setup.h"
+#include "pvgen_models.h"
+#include "pvgen_nominal_model.h"
+#include "mppt_inccond.h"
+#include "mppt_mlamhf.h"
+#include "mppt_temperaturehf.h"
+#include "mppt_gscan.h"
+#include "solver_stats.h"
+
+using namespace std;
+
+int iHelp, iJson, iFilter, iMinTime, iRepeat, iList;
+arg_t args[] = {
+	{"-h",         &iHelp,    ARG_FLAG},
+	{"--help",     &iHelp,    ARG_FLAG},
+	{"--json",     &iJson,    ARG_DEFAULT},
+	{"--filter",   &iFilter,  ARG_DEFAULT},
+	{"--min-time", &iMinTime, ARG_DEFAULT},
+	{"--repeat",   &iRepeat,  ARG_DEFAULT},
+	{"--list",     &iList,    ARG_FLAG},
+	{0,0,0}
+};
+
+struct result {
+	string name;
+	long iterations; // Per timed run
+	double ns;       // Per operation, best run
+	double cycles;   // Per operation, best run
+};
+static vector<result> results;
+static const char *filter = 0;
+static double min_time = 0.2;
+static int repeat = 5;
+static volatile double sink;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static bool wanted(const string &name) {
+	return !filter || name.find(filter) != string::npos;
+}
+
+// Times op(i), i = 0, 1, 2..., which returns something to keep it from being
+// optimised away. The iteration count doubles until a run takes min_time,
+// then the best of repeat runs of that count is kept.
+template <typename op_t>
+static void bench(const string &name, op_t op) {
+	if (!wanted(name)) return;
+	if (iList) {
+		cout<<name<<endl;
+		return;
+	}
+	
+	double s = 0;
+	long n = 1;
+	for (;;) {
+		double t0 = now();
+		for (long i=0; i<n; ++i) s += op(i);
+		if (now() - t0 >= min_time || n >= (1L<<40)) break;
+		n *= 2;
+	}
+	
+	result r;
+	r.name = name;
+	r.iterations = n;
+	r.ns = r.cycles = HUGE_VAL;
+	for (int k=0; k<repeat; ++k) {
+		double t0 = now();
+		timestamp c0 = read_timestamp_counter();
+		for (long i=0; i<n; ++i) s += op(i);
+		timestamp c1 = read_timestamp_counter();
+		double t1 = now();
+		if (1e9*(t1-t0)/n < r.ns) {
+			r.ns = 1e9*(t1-t0)/n;
+			r.cycles = double(c1-c0)/n;
+		}
+	}
+	sink = s;
+	results.push_back(r);
+	
+	cout<<setiosflags(ios::left)<<setw(40)<<r.name<<resetiosflags(ios::left);
+	cout<<setw(12)<<r.iterations;
+	cout<<fixed<<setprecision(1)<<setw(14)<<r.ns<<setw(14)<<r.cycles<<endl;
+	cout.unsetf(ios::fixed);
+}
+
+// Discards the table with --json -. Unlike a null rdbuf it leaves cout
+// good, so widths set for the table are used up as usual.
+struct null_buffer : public streambuf {
+	int overflow(int c) { return traits_type::not_eof(c); }
+};
+
+// JSON string contents. Names are plain ASCII, quotes and backslashes are
+// all that need escaping.
+static string json_escape(const string &s) {
+	string r;
+	for (size_t i=0; i<s.size(); ++i) {
+		if (s[i] == '"' || s[i] == '\\') r += '\\';
+		r += s[i];
+	}
+	return r;
+}
+
+static bool save_json(ostream &out) {
+	out<<"{"<<endl;
+	out<<"  \"cpu_clock\": "<<setprecision(6)<<cpu_clock()<<","<<endl;
+	out<<"  \"min_time\": "<<min_time<<","<<endl;
+	out<<"  \"repeat\": "<<repeat<<","<<endl;
+	out<<"  \"benchmarks\": ["<<endl;
+	for (size_t i=0; i<results.size(); ++i) {
+		const result &r = results[i];
+		out<<"    {\"name\": \""<<json_escape(r.name)<<"\", \"iterations\": "<<r.iterations
+			<<", \"ns_per_op\": "<<setprecision(6)<<r.ns
+			<<", \"cycles_per_op\": "<<r.cycles<<"}"
+			<<(i+1 < results.size() ? "," : "")<<endl;
+	}
+	out<<"  ]"<<endl;
+	out<<"}"<<endl;
+	return bool(out);
+}
+
+// Inputs are cycled through with a power of two mask.
+#define NPOINTS 256
+#define PMASK   (NPOINTS-1)
+
+// Deterministic pseudo-random numbers in [0,1), same on every build.
+static double urand() {
+	static unsigned long long x = 88172645463325252ull;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return (x >> 11) * (1.0/9007199254740992.0);
+}
+
+// Series string of ns modules, with shade cells at 30% of the insolation.
+static void setup_string(pvGenerator_mc &gen, const pvGenerator::model_parameters_t &m, int ns, int shade) {
+	pvGenerator::model_parameters_t s = m;
+	s.Ns *= ns;
+	s.Rs *= ns;
+	s.Rp *= ns;
+	s.m  *= ns;
+	pvgen_setup(gen, s);
+	gen.setBypass(m.Ns/2);
+	gen.setInsolation(1000.);
+	gen.setTemperature(273.16+40);
+	for (int c=0; c<shade; ++c) gen.setInsolation(c, 300.);
+}
+
+static double bilinear_test_fcn(double x, double y, double, void *) {
+	return sin(x)*cos(y) + x*y;
+}
+
+int main(int argc, const char *argv[]) {
+	if (arg_eval(argc, argv, args)) {
+		cerr<<"Error: Command line parsing failed."<<endl;
+		return 1;
+	}
+	if (iHelp) {
+		cout<<"Usage: bench [--filter TEXT] [--min-time S] [--repeat N] [--json FILE] [--list]"<<endl;
+		cout<<"Runs the microbenchmarks whose names contain TEXT, each for at least S"<<endl;
+		cout<<"seconds (0.2) and keeping the best of N runs (5), and reports ns and"<<endl;
+		cout<<"TSC cycles per operation. --json also saves them to FILE, - for stdout."<<endl;
+		return 0;
+	}
+	if (iFilter) filter = argv[iFilter];
+	if (iMinTime) {
+		min_time = strIsFloat(argv[iMinTime]) ? atof(argv[iMinTime]) : -1;
+		if (min_time <= 0) {
+			cerr<<"Error: --min-time requires a positive floating point parameter."<<endl;
+			return 1;
+		}
+	}
+	if (iRepeat) {
+		repeat = strIsInt(argv[iRepeat]) ? atoi(argv[iRepeat]) : -1;
+		if (repeat <= 0) {
+			cerr<<"Error: --repeat requires a positive integer parameter."<<endl;
+			return 1;
+		}
+	}
+	
+	// With --json -, results go to stdout alone.
+	null_buffer discard;
+	streambuf *coutbuf = cout.rdbuf();
+	if (iJson && !strcmp(argv[iJson], "-")) cout.rdbuf(&discard);
+	
+	if (!iList) {
+		cout<<"<< Microbenchmarks >>"<<endl;
+		cout<<"TSC at "<<cpu_clock()/1e9<<" GHz."<<endl;
+		cout<<"Benchmark                               Iterations         ns/op     cycles/op"<<endl;
+	}
+	
+	const pvGenerator::parameters_t &kc = generators[GEN_KC130TM];
+	const pvGenerator::model_parameters_t &m = kc.model;
+	
+	// Single-cell model, operating points over the whole curve.
+	pvGenerator_sc sc;
+	pvgen_setup(sc, m);
+	sc.setInsolation(1000.);
+	sc.setTemperature(273.16+40);
+	vector<double> Is(NPOINTS), Vs(NPOINTS);
+	for (int i=0; i<NPOINTS; ++i) {
+		Is[i] = urand()*0.95*sc.getSourceCurrent();
+		Vs[i] = urand()*0.95*kc.nameplate.Voc;
+	}
+	bench("pvgen_sc::V", [&](long i) { return sc.V(Is[i&PMASK]); });
+	bench("pvgen_sc::I", [&](long i) { return sc.I(Vs[i&PMASK]); });
+	bench("pvgen_mpp_I sc", [&](long i) {
+		sc.setInsolation(100. + 900.*(i&15)/15);
+		return pvgen_mpp_I(sc, 0, sc.getSourceCurrent(), 1e-4);
+	});
+	
+	// Multi-cell strings of 1, 2 and 4 modules, unshaded, with one sixth
+	// and with half of their cells shaded.
+	const int strings[] = {1, 2, 4};
+	const int shades[]  = {0, 6, 18}; // Per module of 36 cells
+	for (int s=0; s<3; ++s) for (int h=0; h<3; ++h) {
+		int ns = strings[s], shade = shades[h]*ns;
+		pvGenerator_mc mc;
+		setup_string(mc, m, ns, shade);
+		ostringstream tag;
+		tag<<" "<<m.Ns*ns<<" cells "<<shade<<" shaded";
+		
+		double Isc = mc.getSourceCurrent(), Voc = kc.nameplate.Voc*ns;
+		for (int i=0; i<NPOINTS; ++i) {
+			Is[i] = urand()*0.95*Isc;
+			Vs[i] = urand()*0.95*Voc;
+		}
+		bench("pvgen_mc::V" + tag.str(), [&](long i) { return mc.V(Is[i&PMASK]); });
+		bench("pvgen_mc::I" + tag.str(), [&](long i) { return mc.I(Vs[i&PMASK]); });
+		if (shade && ns == 1) {
+			bench("pvgen_gmpp_I" + tag.str(), [&](long) {
+				return pvgen_gmpp_I(mc, 0, mc.getSourceCurrent(), 1e-4);
+			});
+		}
+	}
+	
+	// Map lookup, MLAM sized.
+	bilinear_interpolator bi;
+	bi.setFunction(bilinear_test_fcn, 0);
+	bi.setX(0, 12, 128);
+	bi.setY(25, 100, 4);
+	bi.build(1);
+	vector<double> Xs(NPOINTS), Ys(NPOINTS);
+	for (int i=0; i<NPOINTS; ++i) {
+		Xs[i] = urand()*12;
+		Ys[i] = 25 + urand()*75;
+	}
+	bench("bilinear_interpolator", [&](long i) { return bi(Xs[i&PMASK], Ys[i&PMASK]); });
+	
+	// Trackers, on measurements near the MPP at varying G and T.
+	vector<double> tV(NPOINTS), tI(NPOINTS), tT(NPOINTS);
+	for (int i=0; i<NPOINTS; ++i) {
+		tT[i] = 25 + 40*urand();
+		sc.setInsolation(200 + 800*urand());
+		sc.setTemperature(tT[i] + 273.16);
+		tV[i] = kc.nameplate.Vmp*(0.8 + 0.3*urand());
+		tI[i] = sc.I(tV[i]);
+	}
+	
+	mppt_inccond ic;
+	ic.dVr = 0.1;
+	bench("mppt_inccond", [&](long i) { return ic(tV[i&PMASK], tI[i&PMASK]); });
+	
+	mppt_temperaturehf temp;
+	temp.Vmpref = kc.nameplate.Vmp;
+	temp.Tref   = kc.nameplate.Tr;
+	temp.kVT    = kc.nameplate.kT_Voc;
+	temp.dVr    = 0.01;
+	bench("mppt_temperaturehf", [&](long i) { return temp(tV[i&PMASK], tI[i&PMASK], tT[i&PMASK]+273.16); });
+	
+	mppt_gscan_adaptive gs;
+	gs.npeaks = 2;
+	gs.Vpeak  = kc.nameplate.Vmp*0.8/2;
+	gs.Imax   = kc.nameplate.Isc*1.2;
+	bench("mppt_gscan_adaptive", [&](long i) { return gs(tV[i&PMASK], tI[i&PMASK]); });
+	
+	if (wanted("mppt_mlam") || wanted("mppt_mlamhf")) { // The map takes a while
+		mppt_mlamhf mlam;
+		pvGenerator::model_parameters_t mm = pvgen_nominal_model(kc.nameplate);
+		mm.Rs += 0.16;
+		mlam.Iphr = mm.Iph * 1000/mm.G;
+		mlam.mr   = mm.m;
+		mlam.Ior  = mm.I0;
+		mlam.Rs   = mm.Rs;
+		mlam.Rp   = mm.Rp;
+		mlam.Tr   = mm.T - 273.16;
+		mlam.Ns   = mm.Ns;
+		mlam.dVr  = 0.01;
+		if (!iList) mlam.setMap(0, mlam.Iphr*1.5, 128, 25, 100, 4);
+		const mppt_mlam &mlamonly = mlam;
+		bench("mppt_mlam", [&](long i) { return mlamonly(tI[i&PMASK], tT[i&PMASK]); });
+		bench("mppt_mlamhf", [&](long i) { return mlam(tV[i&PMASK], tI[i&PMASK], tT[i&PMASK]); });
+	}
+	
+	// Stimuli files, 1000 samples of Time, G and T.
+	map<string, vector<double> > dat;
+	for (int i=0; i<1000; ++i) {
+		dat["Time"].push_back(i);
+		dat["G"].push_back(200 + 800*urand());
+		dat["T"].push_back(25 + 40*urand());
+	}
+	ostringstream datfile;
+	save_dat(datfile, dat);
+	string dattext = datfile.str();
+	bench("save_dat 1000x3", [&](long) {
+		ostringstream out;
+		save_dat(out, dat);
+		return double(out.tellp());
+	});
+	bench("load_dat 1000x3", [&](long) {
+		istringstream in(dattext);
+		return double(load_dat(in)["G"].size());
+	});
+	bench("matv4_add 1000", [&](long) {
+		ostringstream out;
+		matv4_add(out, "G", dat["G"]);
+		return double(out.tellp());
+	});
+	
+	// Serial command formatting
+	vector<double> fv(NPOINTS);
+	for (int i=0; i<NPOINTS; ++i) fv[i] = 40*urand() - 20;
+	bench("kepco_bop::float_to_string", [&](long i) {
+		return double(kepco_bop::float_to_string(fv[i&PMASK]).size());
+	});
+	scpi_line line;
+	bench("scpi_line::number", [&](long i) {
+		line.clear();
+		line<<"volt ";
+		return double(line.number(fv[i&PMASK], 3).length());
+	});
+	
+	if (!iList) SOLVER_STATS_REPORT(cout);
+	
+	cout.rdbuf(coutbuf);
+	if (iJson && !iList) {
+		if (!strcmp(argv[iJson], "-")) {
+			save_json(cout);
+		} else {
+			ofstream out(argv[iJson]);
+			if (!out || !save_json(out)) {
+				cerr<<"Error: Failed to write \""<<argv[iJson]<<"\"."<<endl;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
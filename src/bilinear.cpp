@@ -1,122 +1,313 @@
-/***************************************************************************
- *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
- *                                                                         *
- *   This program is free software; you can redistribute it and/or modify  *
- *   it under the terms of the GNU General Public License as published by  *
- *   the Free Software Foundation; either version 2 of the License, or     *
- *   (at your option) any later version.                                   *
- *                                                                         *
- *   This program is distributed in the hope that it will be useful,       *
- *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
- *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
- *   GNU General Public License for more details.                          *
- *                                                                         *
- *   You should have received a copy of the GNU General Public License     *
- *   along with this program; if not, write to the                         *
- *   Free Software Foundation, Inc.,                                       *
- *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
- ***************************************************************************/
-
-#include "bilinear.h"
-
-void bilinear_interpolator::buildMap() {
-	if (!nx || !ny || !f) return;
-	
-	// Memory Allocation
-	map = new double*[ny];
-	if (!map) return; // Failed
-	for (int i=0; i<ny; ++i) {
-		map[i] = new double[nx];
-		if (!map[i]) { // Failed
-			while (i--) delete [] map[i];
-			delete [] map;
-			return;
-		}
-	}
-	
-	// Map calculation
-	for (int iy=0; iy<ny; ++iy) {
-		for (int ix=0; ix<nx; ++ix) {
-			map[iy][ix] = f(x0+dx*ix, y0+dy*iy, p);
-		}
-	}
-}
-
-void bilinear_interpolator::freeMap() {
-	if (!map) return;
-	
-	for (int i=0; i<ny; ++i) delete [] map[i];
-	delete [] map;
-}
-
-void bilinear_interpolator::setX(double nx0, double nx1, int n) {
-	freeMap(); // Clear previous map
-	if (nx1 < nx0) { // Ensure nx0<nx1
-		double d = nx0;
-		nx0 = nx1;
-		nx1 = d;
-	}
-	x0 = nx0;
-	nx = n;
-	dx = (nx1-nx0)/(nx-1);
-	buildMap(); // Build new map, if possible
-}
-void bilinear_interpolator::setY(double ny0, double ny1, int n) {
-	freeMap(); // Clear previous map
-	if (ny1 < ny0) { // Ensure ny0<right
-		double d = ny0;
-		ny0 = ny1;
-		ny1 = d;
-	}
-	y0 = ny0;
-	ny = n;
-	dy = (ny1-ny0)/(ny-1);
-	buildMap(); // Build new map, if possible
-}
-
-
-double bilinear_interpolator::operator() (double x, double y) const {
-	if (!map) return 0;
-
-#ifndef DEBUG
-	// Silent extrapolation.
-	int          ix = int((x-x0)/dx);
-	if (ix<0)    ix = 0;
-	if (ix>nx-2) ix = nx-2;
-	int          iy = int((y-y0)/dy);
-	if (iy<0)    iy = 0;
-	if (iy>ny-2) iy = ny-2;
-#else
-	// Warn of extrapolation.
-	bool is_out_of_range = false;
-	int ix = int((x-x0)/dx);
-	if (ix<0) {
-		ix = 0;
-		is_out_of_range = true;
-	}
-	if (ix>nx-2) {
-		ix = nx-2;
-		is_out_of_range = true;
-	}
-	int iy = int((y-y0)/dy);
-	if (iy<0) {
-		iy = 0;
-		is_out_of_range = true;
-	}
-	if (iy>ny-2) {
-		iy = ny-2;
-		is_out_of_range = true;
-	}
-	
-	// Warn only once to prevent flood.
-	static bool had_out_of_range = false;
-	if (is_out_of_range && !had_out_of_range) {
-		had_out_of_range = true;
-		debug_say("Bilinear interpolation limits exceeded. Results may be inacurate.");
-	}
-#endif
-
-	double zy0 = (x-(x0+ix*dx))*(map[iy  ][ix+1]-map[iy  ][ix])/dx + map[iy  ][ix];
-	double zy1 = (x-(x0+ix*dx))*(map[iy+1][ix+1]-map[iy+1][ix])/dx + map[iy+1][ix];
-	return (y-(y0+iy*dy))*(zy1-zy0)/dy + zy0;
-}
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "bilinear.h"
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "debug.h"
+
+// Nodes are built in chunks of a row, seeding each node from its left
+// neighbour. Chunks are handed to the worker threads on demand.
+#define BILINEAR_CHUNK 16
+
+struct bilinear_build_job {
+	const bilinear_interpolator *bi;
+	double *z;
+	int nx, ny, nchunk;
+	std::atomic<int> next;
+};
+
+void bilinear_interpolator::buildChunk(double *z, int iy, int ix0, int ix1) const {
+	double guess = NAN;
+	for (int ix=ix0; ix<ix1; ++ix) {
+		z[iy*nx + ix] = guess = f(x0+dx*ix, y0+dy*iy, guess, p);
+		if (!std::isfinite(guess)) guess = NAN; // Do not propagate failures
+	}
+}
+
+void *bilinear_interpolator::buildWorker(void *ptr) {
+	bilinear_build_job *job = (bilinear_build_job *)ptr;
+	int nc = (job->nx + BILINEAR_CHUNK-1) / BILINEAR_CHUNK;
+	for (;;) {
+		int i = job->next++;
+		if (i >= job->nchunk) break;
+		int iy  = i / nc;
+		int ix0 = i % nc * BILINEAR_CHUNK;
+		int ix1 = ix0 + BILINEAR_CHUNK;
+		if (ix1 > job->nx) ix1 = job->nx;
+		job->bi->buildChunk(job->z, iy, ix0, ix1);
+	}
+	return 0;
+}
+
+void bilinear_interpolator::build(int nthreads) {
+	freeMap();
+	if (nx<2 || ny<2 || !f) return;
+	
+	// Memory Allocation, single aligned block
+	void *mem;
+	if (posix_memalign(&mem, BILINEAR_ALIGN, sizeof(double)*4*(nx-1)*(ny-1)))
+		return; // Failed
+	
+	// Node calculation
+	bilinear_build_job job;
+	job.bi = this;
+	job.z  = new double[nx*ny];
+	job.nx = nx;
+	job.ny = ny;
+	job.nchunk = ny * ((nx + BILINEAR_CHUNK-1) / BILINEAR_CHUNK);
+	job.next = 0;
+	
+	if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > job.nchunk) nthreads = job.nchunk;
+	std::vector<pthread_t> th(nthreads > 1 ? nthreads-1 : 0);
+	int started = 0;
+	for (; started < int(th.size()); ++started) {
+		if (pthread_create(&th[started], 0, buildWorker, &job)) break;
+	}
+	buildWorker(&job); // This thread works too
+	for (int i=0; i<started; ++i) pthread_join(th[i], 0);
+	
+	// Each node is stored on every cell it is a corner of.
+	cell = (double*)mem;
+	double *c = cell;
+	for (int iy=0; iy<ny-1; ++iy) {
+		const double *z0 = job.z + nx*iy;
+		const double *z1 = z0 + nx;
+		for (int ix=0; ix<nx-1; ++ix, c+=4) {
+			c[0] = z0[ix];
+			c[1] = z0[ix+1];
+			c[2] = z1[ix];
+			c[3] = z1[ix+1];
+		}
+	}
+	delete [] job.z;
+}
+
+double bilinear_interpolator::node(int ix, int iy) const {
+	if (!cell || ix<0 || ix>=nx || iy<0 || iy>=ny) return NAN;
+	int cx = ix < nx-1 ? ix : nx-2;
+	int cy = iy < ny-1 ? iy : ny-2;
+	return cell[4*(cy*(nx-1) + cx) + (ix-cx) + 2*(iy-cy)];
+}
+
+bool bilinear_interpolator::rebuildRow(int iy, builder_fcn fcn, void *par) {
+	if (!cell || mapped || !fcn || iy<0 || iy>=ny) return false;
+	
+	// Seeded from the old value of each node, likely close to the new one.
+	double y = y0 + dy*iy;
+	for (int ix=0; ix<nx; ++ix) {
+		double guess = node(ix,iy);
+		if (!std::isfinite(guess)) guess = NAN;
+		double z = fcn(x0 + dx*ix, y, guess, par);
+		
+		// Every cell the node is a corner of
+		for (int cy=iy-1; cy<=iy; ++cy) {
+			if (cy<0 || cy>ny-2) continue;
+			for (int cx=ix-1; cx<=ix; ++cx) {
+				if (cx<0 || cx>nx-2) continue;
+				cell[4*(cy*(nx-1) + cx) + (ix-cx) + 2*(iy-cy)] = z;
+			}
+		}
+	}
+	return true;
+}
+
+void bilinear_interpolator::freeMap() {
+	if (!cell) return;
+	
+	if (mapped) munmap(mapped, mapped_len);
+	else free(cell);
+	cell = 0;
+	mapped = 0;
+}
+
+bilinear_interpolator::bilinear_interpolator(const bilinear_interpolator &o) : cell(0), mapped(0), mapped_len(0) {
+	*this = o;
+}
+
+bilinear_interpolator::bilinear_interpolator(bilinear_interpolator &&o) : cell(0), mapped(0), mapped_len(0) {
+	*this = std::move(o);
+}
+
+bilinear_interpolator &bilinear_interpolator::operator=(const bilinear_interpolator &o) {
+	if (this == &o) return *this;
+	freeMap();
+	x0 = o.x0; dx = o.dx; rdx = o.rdx; nx = o.nx;
+	y0 = o.y0; dy = o.dy; rdy = o.rdy; ny = o.ny;
+	f = o.f;
+	p = o.p;
+	if (!o.cell) return *this;
+	
+	size_t n = sizeof(double)*4*(nx-1)*(ny-1);
+	void *mem;
+	if (posix_memalign(&mem, BILINEAR_ALIGN, n)) return *this; // Failed
+	cell = (double*)memcpy(mem, o.cell, n);
+	return *this;
+}
+
+bilinear_interpolator &bilinear_interpolator::operator=(bilinear_interpolator &&o) {
+	if (this == &o) return *this;
+	freeMap();
+	x0 = o.x0; dx = o.dx; rdx = o.rdx; nx = o.nx;
+	y0 = o.y0; dy = o.dy; rdy = o.rdy; ny = o.ny;
+	f = o.f;
+	p = o.p;
+	cell = o.cell; // Steal the buffer
+	mapped = o.mapped;
+	mapped_len = o.mapped_len;
+	o.cell = 0;
+	o.mapped = 0;
+	return *this;
+}
+
+void bilinear_interpolator::setX(double nx0, double nx1, int n) {
+	freeMap(); // Clear previous map
+	if (nx1 < nx0) { // Ensure nx0<nx1
+		double d = nx0;
+		nx0 = nx1;
+		nx1 = d;
+	}
+	x0 = nx0;
+	nx = n;
+	dx = (nx1-nx0)/(nx-1);
+	rdx = 1/dx;
+}
+void bilinear_interpolator::setY(double ny0, double ny1, int n) {
+	freeMap(); // Clear previous map
+	if (ny1 < ny0) { // Ensure ny0<right
+		double d = ny0;
+		ny0 = ny1;
+		ny1 = d;
+	}
+	y0 = ny0;
+	ny = n;
+	dy = (ny1-ny0)/(ny-1);
+	rdy = 1/dy;
+}
+
+// Map file layout, version 1: header, nkey doubles of key, zero padding up
+// to data_offset, then the cell buffer exactly as kept in memory.
+#define BILINEAR_FILE_MAGIC   "BILINMAP"
+#define BILINEAR_FILE_VERSION 1
+
+struct bilinear_file_header {
+	char     magic[8];
+	uint32_t version;
+	uint32_t byte_order; // 0x01020304 as written by the host
+	uint32_t nkey;
+	int32_t  nx, ny;
+	uint32_t data_offset;
+	double   x0, dx, y0, dy;
+};
+
+bool bilinear_interpolator::save(const char *filename, const double *key, int nkey) const {
+	if (!cell) return false;
+	
+	bilinear_file_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, BILINEAR_FILE_MAGIC, 8);
+	h.version     = BILINEAR_FILE_VERSION;
+	h.byte_order  = 0x01020304;
+	h.nkey        = nkey;
+	h.nx = nx; h.ny = ny;
+	h.x0 = x0; h.dx = dx;
+	h.y0 = y0; h.dy = dy;
+	size_t head = sizeof(h) + sizeof(double)*nkey;
+	h.data_offset = (head + BILINEAR_ALIGN-1) / BILINEAR_ALIGN * BILINEAR_ALIGN;
+	
+	// Write to a temporary and rename, so readers never see a partial file.
+	std::string tmp = std::string(filename) + "." + std::to_string(getpid()) + ".tmp";
+	int fd = ::open(tmp.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd < 0) return false;
+	
+	std::vector<char> pad(h.data_offset - head, 0);
+	size_t n = sizeof(double)*4*(nx-1)*(ny-1);
+	bool ok =
+		::write(fd, &h, sizeof(h)) == ssize_t(sizeof(h)) &&
+		::write(fd, key, sizeof(double)*nkey) == ssize_t(sizeof(double)*nkey) &&
+		::write(fd, pad.data(), pad.size()) == ssize_t(pad.size()) &&
+		::write(fd, cell, n) == ssize_t(n);
+	ok = !::close(fd) && ok;
+	if (ok) ok = !rename(tmp.c_str(), filename);
+	if (!ok) unlink(tmp.c_str());
+	return ok;
+}
+
+bool bilinear_interpolator::load(const char *filename, const double *key, int nkey) {
+	freeMap();
+	
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	void *mem = MAP_FAILED;
+	if (!fstat(fd, &st) && size_t(st.st_size) >= sizeof(bilinear_file_header))
+		mem = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd); // The mapping stays valid
+	if (mem == MAP_FAILED) return false;
+	
+	// Validate everything before trusting the data
+	const bilinear_file_header &h = *(const bilinear_file_header *)mem;
+	size_t head = sizeof(h) + sizeof(double)*nkey;
+	bool ok =
+		!memcmp(h.magic, BILINEAR_FILE_MAGIC, 8) &&
+		h.version == BILINEAR_FILE_VERSION &&
+		h.byte_order == 0x01020304 &&
+		h.nkey == uint32_t(nkey) &&
+		h.nx >= 2 && h.ny >= 2 &&
+		h.data_offset >= head && h.data_offset % BILINEAR_ALIGN == 0 &&
+		size_t(st.st_size) == h.data_offset + sizeof(double)*4*size_t(h.nx-1)*(h.ny-1) &&
+		!memcmp((const char *)mem + sizeof(h), key, sizeof(double)*nkey);
+	if (!ok) {
+		munmap(mem, st.st_size);
+		return false;
+	}
+	
+	x0 = h.x0; dx = h.dx; rdx = 1/dx; nx = h.nx;
+	y0 = h.y0; dy = h.dy; rdy = 1/dy; ny = h.ny;
+	mapped = mem;
+	mapped_len = st.st_size;
+	cell = (double *)((char *)mem + h.data_offset);
+	return true;
+}
+
+void bilinear_interpolator::operator() (const double *x, const double *y, double *z, int n) const {
+	for (int i=0; i<n; ++i) z[i] = (*this)(x[i], y[i]);
+}
+
+// Warn of extrapolation, only once to prevent flood. Maps are shared by
+// trackers on several threads, hence the atomic flag.
+void bilinear_interpolator::warnRange() const {
+#ifdef DEBUG
+	static std::atomic<bool> had_out_of_range(false);
+	if (had_out_of_range.exchange(true, std::memory_order_relaxed)) return;
+	debug_say("Bilinear interpolation limits exceeded. Results may be inacurate.");
+#endif
+}
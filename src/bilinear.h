@@ -1,53 +1,128 @@
-/***************************************************************************
- *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
- *                                                                         *
- *   This program is free software; you can redistribute it and/or modify  *
- *   it under the terms of the GNU General Public License as published by  *
- *   the Free Software Foundation; either version 2 of the License, or     *
- *   (at your option) any later version.                                   *
- *                                                                         *
- *   This program is distributed in the hope that it will be useful,       *
- *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
- *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
- *   GNU General Public License for more details.                          *
- *                                                                         *
- *   You should have received a copy of the GNU General Public License     *
- *   along with this program; if not, write to the                         *
- *   Free Software Foundation, Inc.,                                       *
- *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
- ***************************************************************************/
-
-#ifndef BILINEAR_H
-#define BILINEAR_H
-
-class bilinear_interpolator {
-	typedef double (*builder_fcn)(double X, double Y, void *p);
-	
-	double x0, dx, y0, dy;
-	int nx, ny;
-	double **map;
-	
-	builder_fcn f;
-	void *p;
-	
-	void freeMap();
-	void buildMap();
-	
-	public:
-	bilinear_interpolator() : nx(0), ny(0), map(0), f(0), x0(0), y0(0), dx(0), dy(0) {}
-	~bilinear_interpolator() { freeMap(); }
-	
-	void setFunction(builder_fcn fcn, void *par) {
-		freeMap();
-		f = fcn;
-		p = par;
-		buildMap();
-	}
-	builder_fcn getFunction() const { return f; }
-	void setX(double nx0, double nx1, int n);
-	void setY(double ny0, double ny1, int n);
-	double operator () (double x, double y) const;
-	operator bool () const { return map; }
-};
-
-#endif
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef BILINEAR_H
+#define BILINEAR_H
+
+// Alignment of the cell buffer, in bytes. One cache line on x86 and most ARMs.
+#define BILINEAR_ALIGN 64
+
+#include <cstddef>
+
+class bilinear_interpolator {
+	// Node builder. guess is the value of an already built neighbour node, or
+	// NAN when there is none, and may be used to seed iterative solvers.
+	typedef double (*builder_fcn)(double X, double Y, double guess, void *p);
+	
+	double x0, dx, y0, dy;
+	double rdx, rdy; // 1/dx and 1/dy, avoids divisions on lookup
+	int nx, ny;
+	
+	// Cell-major storage: cell (ix,iy) keeps its four corners
+	//   { z(ix,iy), z(ix+1,iy), z(ix,iy+1), z(ix+1,iy+1) }
+	// on 32 consecutive bytes, so a lookup touches a single cache line.
+	double *cell;
+	
+	// When loaded from a file the cells live in a read-only mapping of it.
+	void *mapped;
+	size_t mapped_len;
+	
+	builder_fcn f;
+	void *p;
+	
+	void freeMap();
+	void buildChunk(double *z, int iy, int ix0, int ix1) const;
+	static void *buildWorker(void *job);
+	void warnRange() const; // Only warns in debug builds of bilinear.cpp
+	
+	public:
+	bilinear_interpolator() : x0(0), dx(0), y0(0), dy(0), rdx(0), rdy(0), nx(0), ny(0), cell(0), mapped(0), mapped_len(0), f(0), p(0) {}
+	bilinear_interpolator(const bilinear_interpolator &o);
+	bilinear_interpolator(bilinear_interpolator &&o);
+	~bilinear_interpolator() { freeMap(); }
+	bilinear_interpolator &operator=(const bilinear_interpolator &o);
+	bilinear_interpolator &operator=(bilinear_interpolator &&o);
+	
+	// Setup. These only discard the current map, call build() when done.
+	void setFunction(builder_fcn fcn, void *par) {
+		freeMap();
+		f = fcn;
+		p = par;
+	}
+	builder_fcn getFunction() const { return f; }
+	void dropFunction() { f = 0; p = 0; } // Keeps the map, for when par goes away
+	void setX(double nx0, double nx1, int n);
+	void setY(double ny0, double ny1, int n);
+	
+	// Builds the map from the function and axes set above, on nthreads
+	// threads (0 for one per online CPU). Check operator bool for success.
+	void build(int nthreads=0);
+	
+	// Binary map files. key identifies what the map was built from, and load()
+	// fails unless it matches the saved one. The file is mapped read-only, so
+	// concurrent processes loading it share the same physical pages. Both
+	// return true on success.
+	bool save(const char *filename, const double *key, int nkey) const;
+	bool load(const char *filename, const double *key, int nkey);
+	
+	// Nodes, at (x0 + ix*dx, y0 + iy*dy).
+	int sizeX() const { return nx; }
+	int sizeY() const { return ny; }
+	double nodeX(int ix) const { return x0 + ix*dx; }
+	double nodeY(int iy) const { return y0 + iy*dy; }
+	double node(int ix, int iy) const;
+	
+	// Recomputes row iy from fcn, leaving the map's own function alone. Meant
+	// for updating a private copy of a shared map. Fails on maps loaded from
+	// a file, which are read-only.
+	bool rebuildRow(int iy, builder_fcn fcn, void *par);
+	
+	double operator () (double x, double y) const;
+	// Batch lookup: z[i] = map(x[i], y[i]) for 0 <= i < n.
+	void operator () (const double *x, const double *y, double *z, int n) const;
+	size_t memory() const { return cell ? 4*(nx-1)*(ny-1)*sizeof(double) : 0; }
+	operator bool () const { return cell; }
+};
+
+inline double bilinear_interpolator::operator() (double x, double y) const {
+	if (!cell) return 0;
+	
+	double fx = (x-x0)*rdx;
+	double fy = (y-y0)*rdy;
+	int ix = int(fx);
+	int iy = int(fy);
+	
+	// Extrapolation
+	if (ix<0 || ix>nx-2 || iy<0 || iy>ny-2) {
+		warnRange();
+		if (ix<0)    ix = 0;
+		if (ix>nx-2) ix = nx-2;
+		if (iy<0)    iy = 0;
+		if (iy>ny-2) iy = ny-2;
+	}
+	fx -= ix;
+	fy -= iy;
+	
+	const double *c = cell + 4*(iy*(nx-1) + ix);
+	double zy0 = c[0] + fx*(c[1]-c[0]);
+	double zy1 = c[2] + fx*(c[3]-c[2]);
+	return zy0 + fy*(zy1-zy0);
+}
+
+#endif
@@ -0,0 +1,244 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "bilinear_adaptive.h"
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+// Columns and Y level the map starts from, before refining.
+#define START_COLUMNS 8
+#define START_LEVEL   1
+
+// Largest error of a column spanning [x0,x1] with n Y intervals. ex is the
+// error along X, at fractions tx of the width, on every Y step. ey is the
+// error halfway between Y steps, at fractions ty of the width.
+void bilinear_adaptive::colError(double x0, double x1, int n, const double *tx, int ntx, const double *ty, int nty, double &ex, double &ey) const {
+	double h = (ymax-ymin)/n;
+	ex = ey = 0;
+	
+	double zl0 = 0, zr0 = 0, guess = NAN;
+	for (int j=0; j<=n; ++j) {
+		double y = ymin + h*j;
+		double zl = f(x0, y, guess, p);
+		double zr = f(x1, y, zl,    p);
+		guess = std::isfinite(zl) ? zl : NAN;
+		
+		for (int m=0; m<ntx; ++m) {
+			double zi = zl + tx[m]*(zr-zl);
+			double x = x0 + tx[m]*(x1-x0);
+			double e = std::fabs(f(x, y, zi, p) - zi)*weight(x, y);
+			if (e > ex) ex = e; // NaN never is
+		}
+		
+		if (j > 0) for (int m=0; m<nty; ++m) {
+			double zi = (zl0 + ty[m]*(zr0-zl0) + zl + ty[m]*(zr-zl))/2;
+			double x = x0 + ty[m]*(x1-x0);
+			double e = std::fabs(f(x, y - h/2, zi, p) - zi)*weight(x, y - h/2);
+			if (e > ey) ey = e;
+		}
+		zl0 = zl;
+		zr0 = zr;
+	}
+}
+
+static inline int nodes(int level) {
+	return 2*((1 << level) + 1);
+}
+
+// Samples every column at its level, and sets up lookups.
+void bilinear_adaptive::finish(const std::vector<int> &level) {
+	int nc = k.size() - 1;
+	rw.resize(nc);
+	col.resize(nc);
+	z.clear();
+	for (int i=0; i<nc; ++i) {
+		column &c = col[i];
+		c.n   = 1 << level[i];
+		c.rdy = c.n/(ymax-ymin);
+		c.off = z.size();
+		rw[i] = 1/(k[i+1]-k[i]);
+		
+		double guess = NAN;
+		for (int j=0; j<=c.n; ++j) {
+			double y = ymin + (ymax-ymin)*j/c.n;
+			double zl = f(k[i],   y, guess, p);
+			double zr = f(k[i+1], y, zl,    p);
+			z.push_back(zl);
+			z.push_back(zr);
+			guess = std::isfinite(zl) ? zl : NAN;
+		}
+	}
+	
+	// Index: the smallest power of two for which no bucket holds more than
+	// two knots, so locate() scans at most two columns past the one the
+	// bucket points to.
+	std::vector<int> cnt;
+	for (int m=16; ; m*=2) {
+		s = m/(k[nc]-k[0]);
+		cnt.assign(m, 0);
+		int worst = 0;
+		for (int i=1; i<nc; ++i) {
+			int b = int((k[i]-k[0])*s);
+			if (b < m) worst = std::max(worst, ++cnt[b]);
+		}
+		if (worst <= 2 || m >= BILINEAR_ADAPTIVE_MAXINDEX) break;
+	}
+	
+	// Bucket b starts at the column after the last knot of buckets < b.
+	idx.resize(cnt.size());
+	int first = 0;
+	for (size_t b=0; b<cnt.size(); ++b) {
+		idx[b] = std::min(first, nc-1);
+		first += cnt[b];
+	}
+}
+
+void bilinear_adaptive::setFunction(builder_fcn fcn, void *par, weight_fcn wfcn) {
+	z.clear();
+	f = fcn;
+	w = wfcn;
+	p = par;
+}
+
+void bilinear_adaptive::setX(double x0, double x1) {
+	z.clear();
+	xmin = std::min(x0, x1);
+	xmax = std::max(x0, x1);
+}
+
+void bilinear_adaptive::setY(double y0, double y1) {
+	z.clear();
+	ymin = std::min(y0, y1);
+	ymax = std::max(y0, y1);
+}
+
+void bilinear_adaptive::build(double tol, int maxNodes) {
+	static const double half = 0.5, edges[3] = { 0, 1, 0.5 };
+	z.clear();
+	if (!f || !(xmax > xmin) || !(ymax > ymin) || !(tol > 0)) return;
+	
+	// Narrower columns would not fit the index.
+	double minw = (xmax-xmin)/BILINEAR_ADAPTIVE_MAXINDEX;
+	
+	k.resize(START_COLUMNS+1);
+	for (int i=0; i<=START_COLUMNS; ++i) k[i] = xmin + (xmax-xmin)*i/START_COLUMNS;
+	std::vector<int> level(START_COLUMNS, START_LEVEL);
+	int total = START_COLUMNS*nodes(START_LEVEL);
+	
+	// Refine: split columns along X and halve their Y steps where the error
+	// is above tol, worst first, while the node budget lasts.
+	for (;;) {
+		std::vector<std::pair<double,int> > bad; // Error, 2*column + (Y ? 1 : 0)
+		for (size_t i=0; i<level.size(); ++i) {
+			double ex, ey;
+			colError(k[i], k[i+1], 1 << level[i], &half, 1, edges, 2, ex, ey);
+			if (ex > tol && k[i+1]-k[i] >= 2*minw)           bad.push_back(std::make_pair(ex, 2*i));
+			if (ey > tol && level[i] < BILINEAR_ADAPTIVE_MAXLEVEL) bad.push_back(std::make_pair(ey, 2*i+1));
+		}
+		std::sort(bad.rbegin(), bad.rend());
+		
+		std::vector<char> split(level.size(), 0), finer(level.size(), 0);
+		bool changed = false;
+		for (size_t b=0; b<bad.size(); ++b) {
+			int i = bad[b].second/2;
+			int L = level[i] + finer[i];
+			if (bad[b].second & 1) {
+				int more = (nodes(L+1) - nodes(L)) << split[i];
+				if (total + more > maxNodes) continue;
+				finer[i] = 1;
+				total += more;
+			} else {
+				if (total + nodes(L) > maxNodes) continue;
+				split[i] = 1;
+				total += nodes(L);
+			}
+			changed = true;
+		}
+		if (!changed) break;
+		
+		std::vector<double> nk(1, k[0]);
+		std::vector<int> nl;
+		for (size_t i=0; i<level.size(); ++i) {
+			int L = level[i] + finer[i];
+			if (split[i]) {
+				nk.push_back((k[i]+k[i+1])/2);
+				nl.push_back(L);
+			}
+			nk.push_back(k[i+1]);
+			nl.push_back(L);
+		}
+		k.swap(nk);
+		level.swap(nl);
+	}
+	
+	// Coarsen: double Y steps, then merge neighbouring columns, wherever the
+	// error stays within tol. Merges are checked at the shared knot and at
+	// the middle of both columns.
+	for (bool changed=true; changed; ) {
+		changed = false;
+		for (size_t i=0; i<level.size(); ++i) {
+			while (level[i] > 0) {
+				double ex, ey;
+				colError(k[i], k[i+1], 1 << (level[i]-1), &half, 1, edges, 2, ex, ey);
+				if (ex > tol || ey > tol) break;
+				--level[i];
+				changed = true;
+			}
+		}
+		
+		std::vector<double> nk(1, k[0]);
+		std::vector<int> nl;
+		for (size_t i=0; i<level.size(); ++i) {
+			if (i+1 < level.size()) {
+				double r = (k[i+1]-k[i])/(k[i+2]-k[i]);
+				double tx[3] = { r/2, r, (1+r)/2 }, ty[3] = { 0, r, 1 };
+				int L = std::max(level[i], level[i+1]);
+				double ex, ey;
+				colError(k[i], k[i+2], 1 << L, tx, 3, ty, 3, ex, ey);
+				if (ex <= tol && ey <= tol) {
+					nk.push_back(k[i+2]);
+					nl.push_back(L);
+					changed = true;
+					++i;
+					continue;
+				}
+			}
+			nk.push_back(k[i+1]);
+			nl.push_back(level[i]);
+		}
+		k.swap(nk);
+		level.swap(nl);
+	}
+	
+	// Error as built, including cell centres
+	err = 0;
+	for (size_t i=0; i<level.size(); ++i) {
+		double ex, ey;
+		colError(k[i], k[i+1], 1 << level[i], &half, 1, edges, 3, ex, ey);
+		err = std::max(err, std::max(ex, ey));
+	}
+	
+	finish(level);
+}
+
+size_t bilinear_adaptive::memory() const {
+	return k.size()*sizeof(double) + rw.size()*sizeof(double) + col.size()*sizeof(column)
+		+ z.size()*sizeof(double) + idx.size()*sizeof(uint16_t);
+}
@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef BILINEAR_ADAPTIVE_H
+#define BILINEAR_ADAPTIVE_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+// Largest knot index table. Must fit uint16_t indexes.
+#define BILINEAR_ADAPTIVE_MAXINDEX 1024
+// Finest Y resolution of a column, 2^n intervals.
+#define BILINEAR_ADAPTIVE_MAXLEVEL 8
+
+// Bilinear interpolator with error-driven node placement. X is split into
+// columns of arbitrary width, each with its own uniform Y resolution, so a
+// region that needs fine Y steps does not force them on the whole map.
+// build() splits columns and refines their Y steps where the interpolation
+// error against the builder function exceeds a tolerance, then merges and
+// coarsens those that do not need it. Values at a knot shared by columns of
+// different Y resolution may differ by up to the tolerance.
+//
+// Columns are located through a uniform index over X, giving the first
+// candidate for each bucket. The index is sized so buckets hold at most a
+// couple of knots, keeping lookups O(1).
+class bilinear_adaptive {
+	typedef double (*builder_fcn)(double X, double Y, double guess, void *p);
+	typedef double (*weight_fcn)(double X, double Y, void *p);
+	
+	struct column {
+		double rdy; // 1/(Y step)
+		int off;    // First node in z
+		int n;      // Y intervals
+	};
+	
+	// Column i spans [k[i],k[i+1]). Its nodes are stored in pairs, z(k[i],y)
+	// then z(k[i+1],y), for every Y step, so a lookup reads 4 consecutive
+	// values.
+	std::vector<double> k;     // Knots, ascending
+	std::vector<double> rw;    // 1/(k[i+1]-k[i])
+	std::vector<column> col;
+	std::vector<double> z;
+	std::vector<uint16_t> idx; // First column for each bucket
+	double s;                  // Buckets per unit of X
+	double err;
+	
+	double xmin, xmax, ymin, ymax;
+	builder_fcn f;
+	weight_fcn w;
+	void *p;
+	
+	double weight(double x, double y) const { return w ? w(x, y, p) : 1; }
+	
+	void colError(double x0, double x1, int n, const double *tx, int ntx, const double *ty, int nty, double &ex, double &ey) const;
+	void finish(const std::vector<int> &level);
+	int locate(double x) const;
+	
+	public:
+	bilinear_adaptive() : s(0), err(0), xmin(0), xmax(0), ymin(0), ymax(0), f(0), w(0), p(0) {}
+	
+	// Setup. These only discard the current map, call build() when done.
+	// Errors are scaled by wfcn, if given, before comparing them to the
+	// tolerance, so the map may be coarser where accuracy matters less.
+	void setFunction(builder_fcn fcn, void *par, weight_fcn wfcn=0);
+	void setX(double x0, double x1);
+	void setY(double y0, double y1);
+	
+	// Builds a map whose error at cell midpoints is below tol, with at most
+	// maxNodes nodes. Check operator bool for success.
+	void build(double tol, int maxNodes=4096);
+	
+	double operator () (double x, double y) const;
+	
+	// Statistics
+	int columns() const { return col.size(); }
+	int nodeCount() const { return z.size(); }
+	double error() const { return err; } // Largest midpoint error, as built
+	size_t memory() const;
+	
+	operator bool () const { return !z.empty(); }
+};
+
+inline int bilinear_adaptive::locate(double x) const {
+	int n = col.size() - 1;
+	int b = int((x - k[0])*s);
+	if (b < 0) return 0;
+	if (b >= int(idx.size())) return n;
+	int i = idx[b];
+	while (i < n && x >= k[i+1]) ++i;
+	return i;
+}
+
+inline double bilinear_adaptive::operator() (double x, double y) const {
+	if (z.empty()) return 0;
+	
+	// Silent extrapolation, as in bilinear_interpolator.
+	int ix = locate(x);
+	const column &c = col[ix];
+	double fx = (x - k[ix])*rw[ix];
+	double fy = (y - ymin)*c.rdy;
+	int iy = int(fy);
+	if (iy < 0)     iy = 0;
+	if (iy > c.n-1) iy = c.n-1;
+	fy -= iy;
+	
+	const double *q = &z[c.off + 2*iy];
+	double zy0 = q[0] + fx*(q[1]-q[0]);
+	double zy1 = q[2] + fx*(q[3]-q[2]);
+	return zy0 + fy*(zy1-zy0);
+}
+
+#endif
@@ -0,0 +1,204 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "bilinear_lazy.h"
+#include <cmath>
+
+// Floor division, tile coordinates of negative node indexes.
+static inline int floordiv(int a, int b) {
+	return a >= 0 ? a/b : -((b-1-a)/b);
+}
+
+static inline uint64_t tile_key(int tx, int ty) {
+	return (uint64_t(uint32_t(tx)) << 32) | uint32_t(ty);
+}
+
+bilinear_lazy::bilinear_lazy() :
+	x0(0), dx(0), rdx(0), y0(0), dy(0), rdy(0),
+	xmin(-HUGE_VAL), xmax(HUGE_VAL), ymin(-HUGE_VAL), ymax(HUGE_VAL),
+	f(0), p(0), index(0)
+{
+	pthread_mutex_init(&lock, 0);
+}
+
+bilinear_lazy::~bilinear_lazy() {
+	clear();
+	pthread_mutex_destroy(&lock);
+}
+
+// Not safe against concurrent lookups, setup only.
+void bilinear_lazy::clear() {
+	tile_index *x = index.load(std::memory_order_relaxed);
+	if (x) {
+		for (size_t i=0; i<=x->mask; ++i) delete x->s[i].t.load(std::memory_order_relaxed);
+		retired.push_back(x);
+	}
+	for (size_t i=0; i<retired.size(); ++i) {
+		delete[] retired[i]->s;
+		delete retired[i];
+	}
+	retired.clear();
+	index.store(0, std::memory_order_relaxed);
+}
+
+void bilinear_lazy::setFunction(builder_fcn fcn, void *par) {
+	clear();
+	f = fcn;
+	p = par;
+}
+
+void bilinear_lazy::setGrid(double nx0, double ndx, double ny0, double ndy) {
+	clear();
+	x0 = nx0; dx = std::fabs(ndx); rdx = 1/dx;
+	y0 = ny0; dy = std::fabs(ndy); rdy = 1/dy;
+}
+
+void bilinear_lazy::setLimits(double nxmin, double nxmax, double nymin, double nymax) {
+	clear();
+	xmin = nxmin; xmax = nxmax;
+	ymin = nymin; ymax = nymax;
+}
+
+static inline size_t tile_hash(uint64_t key) {
+	return size_t((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+const bilinear_lazy::tile *bilinear_lazy::find(const tile_index *x, uint64_t key) {
+	for (size_t i = tile_hash(key) & x->mask; ; i = (i+1) & x->mask) {
+		const tile *t = x->s[i].t.load(std::memory_order_acquire);
+		if (!t) return 0;
+		if (x->s[i].key.load(std::memory_order_relaxed) == key) return t;
+	}
+}
+
+// Lock must be held.
+void bilinear_lazy::insert(tile_index *x, uint64_t key, tile *t) {
+	size_t i = tile_hash(key) & x->mask;
+	while (x->s[i].t.load(std::memory_order_relaxed)) i = (i+1) & x->mask;
+	x->s[i].key.store(key, std::memory_order_relaxed);
+	x->s[i].t.store(t, std::memory_order_release);
+	++x->used;
+}
+
+bilinear_lazy::tile_index *bilinear_lazy::newIndex(size_t slots) {
+	tile_index *x = new tile_index;
+	x->mask = slots - 1;
+	x->used = 0;
+	x->s = new slot[slots];
+	for (size_t i=0; i<slots; ++i) {
+		x->s[i].key.store(0, std::memory_order_relaxed);
+		x->s[i].t.store(0, std::memory_order_relaxed);
+	}
+	return x;
+}
+
+// Returns the tile, computing its nodes if not done yet. Only misses take
+// the lock.
+const bilinear_lazy::tile *bilinear_lazy::getTile(int tx, int ty) const {
+	uint64_t key = tile_key(tx, ty);
+	tile_index *cur = index.load(std::memory_order_acquire);
+	const tile *found = cur ? find(cur, key) : 0;
+	if (found) return found;
+	
+	pthread_mutex_lock(&lock);
+	cur = index.load(std::memory_order_relaxed);
+	found = cur ? find(cur, key) : 0; // Built by another thread meanwhile?
+	if (!found) {
+		tile *t = new tile;
+		for (int j=0; j<BILINEAR_LAZY_TY; ++j) {
+			double y = y0 + dy*(ty*BILINEAR_LAZY_TY + j);
+			double guess = NAN;
+			for (int i=0; i<BILINEAR_LAZY_TX; ++i) {
+				double x = x0 + dx*(tx*BILINEAR_LAZY_TX + i);
+				t->z[j][i] = guess = f(x, y, guess, p);
+				if (!std::isfinite(guess)) guess = NAN;
+			}
+		}
+		
+		// Keep the index at most half full
+		if (!cur || 2*(cur->used + 1) > cur->mask + 1) {
+			tile_index *n = newIndex(cur ? 2*(cur->mask + 1) : 64);
+			if (cur) {
+				for (size_t i=0; i<=cur->mask; ++i) {
+					tile *o = cur->s[i].t.load(std::memory_order_relaxed);
+					if (o) insert(n, cur->s[i].key.load(std::memory_order_relaxed), o);
+				}
+				retired.push_back(cur); // Readers may still be probing it
+			}
+			index.store(n, std::memory_order_release);
+			cur = n;
+		}
+		insert(cur, key, t);
+		found = t;
+	}
+	pthread_mutex_unlock(&lock);
+	return found;
+}
+
+double bilinear_lazy::node(int ix, int iy) const {
+	int tx = floordiv(ix, BILINEAR_LAZY_TX);
+	int ty = floordiv(iy, BILINEAR_LAZY_TY);
+	return getTile(tx, ty)->z[iy - ty*BILINEAR_LAZY_TY][ix - tx*BILINEAR_LAZY_TX];
+}
+
+double bilinear_lazy::operator() (double x, double y) const {
+	if (!*this || std::isnan(x) || std::isnan(y)) return NAN;
+	
+	// Clamp to limits, then locate the cell
+	if (x < xmin) x = xmin;
+	if (x > xmax) x = xmax;
+	if (y < ymin) y = ymin;
+	if (y > ymax) y = ymax;
+	double fx = (x-x0)*rdx;
+	double fy = (y-y0)*rdy;
+	double flx = std::floor(fx);
+	double fly = std::floor(fy);
+	if (std::fabs(flx) > 1e9 || std::fabs(fly) > 1e9) return NAN; // Unbounded and far away
+	int ix = int(flx);
+	int iy = int(fly);
+	fx -= flx;
+	fy -= fly;
+	
+	double z00 = node(ix,   iy  );
+	double z10 = node(ix+1, iy  );
+	double z01 = node(ix,   iy+1);
+	double z11 = node(ix+1, iy+1);
+	
+	double zy0 = z00 + fx*(z10-z00);
+	double zy1 = z01 + fx*(z11-z01);
+	return zy0 + fy*(zy1-zy0);
+}
+
+int bilinear_lazy::tileCount() const {
+	pthread_mutex_lock(&lock);
+	tile_index *x = index.load(std::memory_order_relaxed);
+	int n = x ? x->used : 0;
+	pthread_mutex_unlock(&lock);
+	return n;
+}
+
+size_t bilinear_lazy::memory() const {
+	pthread_mutex_lock(&lock);
+	size_t m = 0;
+	tile_index *x = index.load(std::memory_order_relaxed);
+	if (x) m += x->used*sizeof(tile) + (x->mask + 1)*sizeof(slot);
+	for (size_t i=0; i<retired.size(); ++i) m += (retired[i]->mask + 1)*sizeof(slot);
+	pthread_mutex_unlock(&lock);
+	return m;
+}
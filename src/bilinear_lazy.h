@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef BILINEAR_LAZY_H
+#define BILINEAR_LAZY_H
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include <pthread.h>
+
+// Bilinear interpolator over an unbounded uniform grid. Nodes are computed on
+// first touch, in tiles of BILINEAR_LAZY_TX x BILINEAR_LAZY_TY, so only the
+// regions actually visited cost build time and memory. Queries outside the
+// limits (if set) are clamped to them instead of growing the map.
+//
+// Lookups of built tiles take no lock, so a map can be shared by trackers
+// running on different threads. Building a tile is serialized by an internal
+// lock.
+#define BILINEAR_LAZY_TX 16
+#define BILINEAR_LAZY_TY 2
+
+class bilinear_lazy {
+	typedef double (*builder_fcn)(double X, double Y, double guess, void *p);
+	
+	struct tile {
+		double z[BILINEAR_LAZY_TY][BILINEAR_LAZY_TX];
+	};
+	
+	double x0, dx, rdx, y0, dy, rdy;
+	double xmin, xmax, ymin, ymax;
+	
+	builder_fcn f;
+	void *p;
+	
+	// Open addressing index of built tiles, at most half full. Readers probe
+	// it without the lock. Tiles are only added, under the lock, and a full
+	// index is replaced by a larger copy, the old one kept until clear().
+	struct slot {
+		std::atomic<uint64_t> key;
+		std::atomic<tile*> t;    // Published after key, 0 for empty
+	};
+	struct tile_index {
+		size_t mask;             // Slots - 1, slots a power of two
+		size_t used;
+		slot *s;
+	};
+	mutable std::atomic<tile_index*> index;
+	mutable std::vector<tile_index*> retired;
+	mutable pthread_mutex_t lock;
+	
+	static const tile *find(const tile_index *x, uint64_t key);
+	static void insert(tile_index *x, uint64_t key, tile *t);
+	static tile_index *newIndex(size_t slots);
+	const tile *getTile(int tx, int ty) const;
+	double node(int ix, int iy) const;
+	
+	// Non-copyable, share it through a pointer instead.
+	bilinear_lazy(const bilinear_lazy &);
+	bilinear_lazy &operator=(const bilinear_lazy &);
+	
+	public:
+	bilinear_lazy();
+	~bilinear_lazy();
+	
+	// Setup. All of these discard nodes computed so far.
+	void setFunction(builder_fcn fcn, void *par);
+	void setGrid(double nx0, double ndx, double ny0, double ndy);
+	void setLimits(double nxmin, double nxmax, double nymin, double nymax);
+	void clear();
+	
+	double operator () (double x, double y) const;
+	
+	// Statistics
+	int tileCount() const;
+	size_t memory() const;
+	
+	operator bool () const { return f && dx > 0 && dy > 0; }
+};
+
+#endif
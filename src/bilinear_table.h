@@ -0,0 +1,108 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef BILINEAR_TABLE_H
+#define BILINEAR_TABLE_H
+
+#include <vector>
+#include <cstddef>
+#include "bilinear.h"
+#include "fixedpoint.h"
+
+// Uniform bilinear lookup on the numeric type real (double, float or qfix),
+// for embedded targets. Same interpolation as bilinear_interpolator, but
+// nodes are stored once, row-major, a quarter of the cell-major memory: on
+// parts without a data cache there is no cache line to save, and RAM is what
+// runs out first. Nothing here builds a map; tables come from a map built in
+// double precision, or from an array exported by mlam2h.
+template <typename real>
+class bilinear_table {
+	real x0, rdx, y0, rdy;
+	int nx, ny;
+	const real *z;      // z[iy*nx + ix]
+	std::vector<real> own;
+	
+	public:
+	bilinear_table() : x0(0), rdx(0), y0(0), rdy(0), nx(0), ny(0), z(0) {}
+	bilinear_table(const bilinear_table &o) { *this = o; }
+	bilinear_table &operator=(const bilinear_table &o);
+	
+	// Converted from a double precision map.
+	explicit bilinear_table(const bilinear_interpolator &m);
+	
+	// Uses an external table in place, nodes at (x0 + ix/rdx, y0 + iy/rdy).
+	bilinear_table(const real *nodes, int nX, int nY, real X0, real rdX, real Y0, real rdY)
+		: x0(X0), rdx(rdX), y0(Y0), rdy(rdY), nx(nX), ny(nY), z(nodes) {}
+	
+	real operator () (real x, real y) const;
+	size_t memory() const { return size_t(nx)*ny*sizeof(real); }
+	operator bool () const { return z && nx > 1 && ny > 1; }
+};
+
+template <typename real>
+bilinear_table<real> &bilinear_table<real>::operator=(const bilinear_table &o) {
+	x0 = o.x0; rdx = o.rdx; nx = o.nx;
+	y0 = o.y0; rdy = o.rdy; ny = o.ny;
+	own = o.own;
+	z = o.own.empty() ? o.z : own.data();
+	return *this;
+}
+
+template <typename real>
+bilinear_table<real>::bilinear_table(const bilinear_interpolator &m)
+	: x0(0), rdx(0), y0(0), rdy(0), nx(0), ny(0), z(0)
+{
+	if (!m || m.sizeX() < 2 || m.sizeY() < 2) return;
+	nx = m.sizeX();
+	ny = m.sizeY();
+	x0  = real(m.nodeX(0));
+	rdx = real(1/(m.nodeX(1) - m.nodeX(0)));
+	y0  = real(m.nodeY(0));
+	rdy = real(1/(m.nodeY(1) - m.nodeY(0)));
+	own.resize(size_t(nx)*ny);
+	for (int iy=0; iy<ny; ++iy)
+		for (int ix=0; ix<nx; ++ix) own[iy*nx + ix] = real(m.node(ix, iy));
+	z = own.data();
+}
+
+template <typename real>
+inline real bilinear_table<real>::operator() (real x, real y) const {
+	if (!z) return real(0);
+	
+	real fx = (x-x0)*rdx;
+	real fy = (y-y0)*rdy;
+	int ix = trunc_int(fx);
+	int iy = trunc_int(fy);
+	
+	// Silent extrapolation.
+	if (ix<0)    ix = 0;
+	if (ix>nx-2) ix = nx-2;
+	if (iy<0)    iy = 0;
+	if (iy>ny-2) iy = ny-2;
+	fx = fx - real(ix);
+	fy = fy - real(iy);
+	
+	const real *c0 = z + iy*nx + ix;
+	const real *c1 = c0 + nx;
+	real zy0 = c0[0] + fx*(c0[1]-c0[0]);
+	real zy1 = c1[0] + fx*(c1[1]-c1[0]);
+	return zy0 + fy*(zy1-zy0);
+}
+
+#endif
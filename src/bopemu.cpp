@@ -0,0 +1,525 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/***************************************************************************
+ *   KEPCO BOP emulator: serves the SCPI subset kepco_bop uses on a        *
+ *   pseudo-terminal, as a supply loading a simulated PV generator that    *
+ *   follows a stimuli file, so that the hardware loop of mppt can run     *
+ *   without the test bench. One process per supply.                       *
+ *                                                                         *
+ *   Temperatures are in Celsius, except for pvGenerator (KELVIN).         *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include "arg_tool.h"
+#include "straux.h"
+#include "load_dat.h"
+#include "pvgen_sc.h"
+#include "pvgen_mc.h"
+#include "pvgen_setup.h"
+#include "pvgen_models.h"
+
+using namespace std;
+
+int iHelp, iStimuli, iGenerator, iShadedCells, iBypassCells, iG, iT;
+int iBaud, iLatency, iSpeed, iEcho, iLink, iVerbose;
+arg_t args[] = {
+	{"-h",                &iHelp,        ARG_FLAG},
+	{"--help",            &iHelp,        ARG_FLAG},
+	{"--stimuli",         &iStimuli,     ARG_DEFAULT},
+	{"--generator-model", &iGenerator,   ARG_DEFAULT},
+	{"--shaded-cells",    &iShadedCells, ARG_DEFAULT},
+	{"--bypass-cells",    &iBypassCells, ARG_DEFAULT},
+	{"-G",                &iG,           ARG_DEFAULT},
+	{"-T",                &iT,           ARG_DEFAULT},
+	{"--baud",            &iBaud,        ARG_DEFAULT},
+	{"--latency",         &iLatency,     ARG_DEFAULT},
+	{"--speed",           &iSpeed,       ARG_DEFAULT},
+	{"--echo",            &iEcho,        ARG_FLAG},
+	{"--link",            &iLink,        ARG_DEFAULT},
+	{"-v",                &iVerbose,     ARG_FLAG},
+	{0,0,0}
+};
+
+static volatile sig_atomic_t quit = 0;
+static void quit_handler(int) { quit = 1; }
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static void sleep_until(double t) {
+	struct timespec ts;
+	ts.tv_sec  = time_t(t);
+	ts.tv_nsec = long(1e9*(t - ts.tv_sec));
+	while (!quit && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+}
+
+//
+// Generator
+//
+
+static pvGenerator_sc gen_sc;
+static pvGenerator_mc gen_mc;
+static pvGenerator *gen = &gen_sc;
+static int shaded = 0;
+static vector<double> Time, G, T, Gs;
+static double G0 = 1000, T0 = 40; // Without stimuli, as mppt emulates the sensors
+static double speed = 1;
+static double start = NAN;        // When the first byte came in
+
+// Sets the generator to the stimuli at the current time, interpolated, the
+// last sample held past the end.
+static void plant_update() {
+	double g = G0, t = T0, gs = G0;
+	if (!Time.empty()) {
+		static size_t k = 0;
+		double ts = Time[0] + speed*(now() - start);
+		while (k+1 < Time.size() && Time[k+1] <= ts) ++k;
+		if (k+1 < Time.size() && ts > Time[k]) {
+			double a = (ts - Time[k]) / (Time[k+1] - Time[k]);
+			g = G[k] + a*(G[k+1] - G[k]);
+			t = T[k] + a*(T[k+1] - T[k]);
+			if (shaded) gs = Gs[k] + a*(Gs[k+1] - Gs[k]);
+		} else {
+			g = G[k];
+			t = T[k];
+			if (shaded) gs = Gs[k];
+		}
+	}
+	gen->setInsolation(g);
+	gen->setTemperature(t > 200 ? t : t + 273.16);
+	for (int c=0; c<shaded; ++c) gen_mc.setInsolation(c, gs);
+}
+
+//
+// Supply
+//
+
+struct bop_state {
+	bool current;   // Current mode, voltage mode otherwise
+	bool output;
+	double Vset;    // Voltage, or its limit in current mode, V
+	double Iset;    // Current, or its limit in voltage mode, A
+	int error;      // SCPI error code, 0 for none
+};
+static bop_state bop;
+
+static void bop_reset() {
+	bop.current = false;
+	bop.output  = false;
+	bop.Vset    = 0;
+	bop.Iset    = 0;
+	bop.error   = 0;
+}
+
+// Output voltage and current. The generator is across the output, so the
+// supply sinks its current: I is negative while harvesting. With the output
+// off the generator is left open.
+static void bop_measure(double &V, double &I) {
+	plant_update();
+	if (!bop.output) {
+		V = gen->V(0);
+		I = 0;
+	} else if (!bop.current) {
+		V = bop.Vset;
+		I = -gen->I(V);
+		if (fabs(I) > bop.Iset) {
+			I = I < 0 ? -bop.Iset : bop.Iset;
+			V = gen->V(-I);
+		}
+	} else {
+		I = bop.Iset;
+		V = gen->V(-I);
+		if (fabs(V) > bop.Vset) {
+			V = V < 0 ? -bop.Vset : bop.Vset;
+			I = -gen->I(V);
+		}
+	}
+}
+
+// SCPI keywords, short and long forms
+static const char *keywords[][2] = {
+	{"sour", "source"},  {"volt", "voltage"}, {"curr", "current"},
+	{"meas", "measure"}, {"func", "function"}, {"mode", "mode"},
+	{"outp", "output"},  {"syst", "system"},   {"rem",  "remote"},
+	{"err",  "error"},   {0, 0}
+};
+
+// Full header in short form, as "meas:volt?", or "" if unknown.
+static string short_header(const string &h) {
+	string r;
+	size_t b = 0;
+	while (b < h.length()) {
+		size_t e = h.find(':', b);
+		if (e == string::npos) e = h.length();
+		string node(h, b, e-b);
+		bool query = !node.empty() && node[node.length()-1] == '?';
+		if (query) node.erase(node.length()-1);
+		int k;
+		for (k=0; keywords[k][0]; ++k)
+			if (node == keywords[k][0] || node == keywords[k][1]) break;
+		if (!keywords[k][0]) return "";
+		if (!r.empty()) r += ':';
+		r += keywords[k][0];
+		if (query) r += '?';
+		b = e+1;
+	}
+	if (r.compare(0, 5, "sour:") == 0) r.erase(0, 5); // Optional node
+	return r;
+}
+
+static string number(double v) {
+	char s[32];
+	snprintf(s, sizeof(s), "%.5E", v);
+	return s;
+}
+
+static bool parse_bool(const string &a, bool &b) {
+	if (a == "on"  || a == "1") b = true;
+	else if (a == "off" || a == "0") b = false;
+	else return false;
+	return true;
+}
+
+// Runs one command, and returns its reply, if a query. Sets bop.error, and
+// returns "", on errors.
+static string bop_command(const string &header, const string &arg, bool &measured, double &V, double &I) {
+	bool hasArg = !arg.empty();
+	if (header == "*rst") { bop_reset(); return ""; }
+	if (header == "*cls") { bop.error = 0; return ""; }
+	if (header == "*idn?") return "KEPCO BOP BIT232 REV. 3.1";
+	
+	string h = short_header(header);
+	if (h == "volt" || h == "curr") {
+		if (!hasArg) { bop.error = -109; return ""; }
+		char *end;
+		double v = strtod(arg.c_str(), &end);
+		if (*end || end == arg.c_str()) { bop.error = -104; return ""; }
+		(h == "volt" ? bop.Vset : bop.Iset) = v;
+		return "";
+	}
+	if (h == "volt?") return number(bop.Vset);
+	if (h == "curr?") return number(bop.Iset);
+	if (h == "meas:volt?" || h == "meas:curr?") {
+		if (!measured) bop_measure(V, I);
+		measured = true;
+		return number(h == "meas:volt?" ? V : I);
+	}
+	if (h == "func:mode") {
+		if (arg.compare(0, 4, "volt") == 0) bop.current = false;
+		else if (arg.compare(0, 4, "curr") == 0) bop.current = true;
+		else bop.error = hasArg ? -104 : -109;
+		return "";
+	}
+	if (h == "func:mode?") return bop.current ? "CURR" : "VOLT";
+	if (h == "outp") {
+		if (!parse_bool(arg, bop.output)) bop.error = hasArg ? -104 : -109;
+		return "";
+	}
+	if (h == "outp?") return bop.output ? "1" : "0";
+	if (h == "syst:rem") {
+		bool b;
+		if (!parse_bool(arg, b)) bop.error = hasArg ? -104 : -109;
+		return "";
+	}
+	if (h == "syst:err?") {
+		const char *msg = "No error";
+		switch (bop.error) {
+			case -104: msg = "Data type error"; break;
+			case -109: msg = "Missing parameter"; break;
+			case -113: msg = "Undefined header"; break;
+		}
+		char s[64];
+		snprintf(s, sizeof(s), "%d,\"%s\"", bop.error, msg);
+		bop.error = 0;
+		return s;
+	}
+	bop.error = -113;
+	return "";
+}
+
+// Runs a command line, and returns the replies of its queries separated by
+// ';'. Headers not starting with ':' are relative to the path left by the
+// one before, as in "meas:volt?;curr?".
+static string bop_line(string line) {
+	for (size_t i=0; i<line.length(); ++i) line[i] = tolower(line[i]);
+	string reply, path;
+	bool measured = false; // One measurement per line
+	double V, I;
+	size_t b = 0;
+	while (b <= line.length()) {
+		size_t e = line.find(';', b);
+		if (e == string::npos) e = line.length();
+		string cmd(line, b, e-b);
+		b = e+1;
+		
+		size_t f = cmd.find_first_not_of(' ');
+		if (f == string::npos) continue;
+		size_t s = cmd.find(' ', f);
+		string header(cmd, f, s == string::npos ? string::npos : s-f);
+		string arg;
+		if (s != string::npos) {
+			size_t a = cmd.find_first_not_of(' ', s);
+			size_t z = cmd.find_last_not_of(' ');
+			if (a != string::npos) arg = string(cmd, a, z-a+1);
+		}
+		
+		if (header[0] == ':') {
+			header.erase(0, 1);
+		} else if (header[0] != '*') {
+			header = path + header;
+		}
+		if (header[0] != '*') {
+			size_t c = header.rfind(':');
+			path = c == string::npos ? "" : string(header, 0, c+1);
+		}
+		
+		bool query = header[header.length()-1] == '?';
+		string r = bop_command(header, arg, measured, V, I);
+		if (query && !r.empty()) {
+			if (!reply.empty()) reply += ';';
+			reply += r;
+		}
+	}
+	return reply;
+}
+
+//
+// Line
+//
+
+static int port = -1;
+static double byte_time = 0; // Per byte, s, 0 for no pacing
+static double tx_free = 0;   // When the next byte out may start
+static double rx_free = 0;   // When the last byte in was done
+
+// Sends to the host, paced at the baud rate.
+static void send(const char *p, int n) {
+	for (int i=0; i<n && !quit; ) {
+		int k = n-i;
+		if (byte_time > 0) {
+			tx_free = max(tx_free, now()) + byte_time;
+			sleep_until(tx_free);
+			k = 1;
+		}
+		int w = write(port, p+i, k);
+		if (w > 0) i += w;
+		else if (w < 0 && errno != EAGAIN && errno != EINTR) return;
+	}
+}
+static void send(const string &s) { send(s.c_str(), s.length()); }
+
+int main(int argc, const char *argv[]) {
+	if (arg_eval(argc, argv, args)) {
+		cerr<<"Error: Command line parsing failed."<<endl;
+		return 1;
+	}
+	if (iHelp) {
+		cout<<"Usage: bopemu [--stimuli FILE] [--generator-model NAME] [--shaded-cells N]"<<endl;
+		cout<<"              [--bypass-cells N] [-G W/m2] [-T C] [--speed X] [--baud N]"<<endl;
+		cout<<"              [--latency MS] [--echo] [--link PATH] [-v]"<<endl;
+		cout<<"Emulates a KEPCO BOP loading a PV generator on a pseudo-terminal, for"<<endl;
+		cout<<"mppt -psu1/-psu2. The generator follows the stimuli from the first byte"<<endl;
+		cout<<"received on, X times as fast, or sees G and T (1000 W/m2, 40 C, as mppt"<<endl;
+		cout<<"emulates the sensors). Bytes take 10 bit times each way at N baud (9600,"<<endl;
+		cout<<"0 for none) and commands MS ms (0) to run. --echo answers as an echoed"<<endl;
+		cout<<"supply, --link makes PATH a link to the terminal, -v logs each command."<<endl;
+		return 0;
+	}
+	
+	const pvGenerator::parameters_t *genparam = &generators[GEN_KC130TM];
+	if (iGenerator) {
+		genparam = generator_by_name(argv[iGenerator]);
+		if (!genparam) {
+			cerr<<"Error: Unknown generator model \""<<argv[iGenerator]<<"\"."<<endl;
+			return 1;
+		}
+	}
+	if (iG) G0 = strIsFloat(argv[iG]) ? atof(argv[iG]) : -1;
+	if (iT) T0 = strIsFloat(argv[iT]) ? atof(argv[iT]) : NAN;
+	if (G0 < 0 || isnan(T0)) {
+		cerr<<"Error: -G and -T require a number."<<endl;
+		return 1;
+	}
+	int baud = 9600;
+	if (iBaud) baud = strIsInt(argv[iBaud]) ? atoi(argv[iBaud]) : -1;
+	if (baud < 0) {
+		cerr<<"Error: --baud requires a non-negative integer."<<endl;
+		return 1;
+	}
+	if (baud) byte_time = 10.0/baud;
+	double latency = 0;
+	if (iLatency) latency = strIsFloat(argv[iLatency]) ? 1e-3*atof(argv[iLatency]) : -1;
+	if (latency < 0) {
+		cerr<<"Error: --latency requires a non-negative number of ms."<<endl;
+		return 1;
+	}
+	if (iSpeed) speed = strIsFloat(argv[iSpeed]) ? atof(argv[iSpeed]) : -1;
+	if (speed <= 0) {
+		cerr<<"Error: --speed requires a positive number."<<endl;
+		return 1;
+	}
+	
+	// Stimuli
+	if (iStimuli) {
+		std::map<std::string, std::vector<double> > stimuli = load_dat(argv[iStimuli]);
+		Time = stimuli["Time"];
+		G    = stimuli["G"];
+		T    = stimuli["T"];
+		Gs   = stimuli["Gs"];
+		if (Time.empty() || G.size() < Time.size() || T.size() < Time.size()) {
+			cerr<<"Error: Stimuli file does not contain required variables Time, G and/or T."<<endl;
+			return 1;
+		}
+	}
+	
+	// Generator, as mppt simulates it
+	int bypass = genparam->nameplate.Ns/2;
+	if (iBypassCells) bypass = strIsInt(argv[iBypassCells]) ? atoi(argv[iBypassCells]) : -1;
+	if (bypass < 0) {
+		cerr<<"Error: --bypass-cells requires a non-negative integer parameter."<<endl;
+		return 1;
+	}
+	if (iShadedCells) {
+		shaded = strIsInt(argv[iShadedCells]) ? atoi(argv[iShadedCells]) : -1;
+		if (shaded < 0 || shaded > genparam->model.Ns) {
+			cerr<<"Error: --shaded-cells requires an integer from 0 to "<<genparam->model.Ns<<"."<<endl;
+			return 1;
+		}
+		if (Gs.size() < Time.size() || Time.empty()) {
+			cerr<<"Error: --shaded-cells requires a stimuli file with variable Gs."<<endl;
+			return 1;
+		}
+	}
+	if (shaded) gen = &gen_mc;
+	pvgen_setup(*gen, genparam->model);
+	if (shaded) gen_mc.setBypass(bypass);
+	bop_reset();
+	
+	// Pseudo-terminal. The slave side is kept open, raw, so the master
+	// stays up while mppt comes and goes.
+	port = posix_openpt(O_RDWR | O_NOCTTY);
+	if (port < 0 || grantpt(port) || unlockpt(port)) {
+		cerr<<"Error: Failed to open a pseudo-terminal: "<<strerror(errno)<<"."<<endl;
+		return 1;
+	}
+	string device = ptsname(port);
+	int slave = open(device.c_str(), O_RDWR | O_NOCTTY);
+	if (slave >= 0) {
+		struct termios t;
+		tcgetattr(slave, &t);
+		cfmakeraw(&t);
+		tcsetattr(slave, TCSANOW, &t);
+	}
+	if (iLink) {
+		unlink(argv[iLink]);
+		if (symlink(device.c_str(), argv[iLink])) {
+			cerr<<"Error: Failed to link "<<argv[iLink]<<": "<<strerror(errno)<<"."<<endl;
+			return 1;
+		}
+	}
+	
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = quit_handler;
+	sigaction(SIGINT,  &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+	
+	cout<<"<< KEPCO BOP emulator >>"<<endl;
+	cout<<"Generator "<<genparam->name;
+	if (shaded) cout<<", "<<shaded<<" cells shaded";
+	if (!Time.empty()) cout<<", "<<Time.size()<<" stimuli samples";
+	cout<<"."<<endl;
+	cout<<"Port "<<device<<"."<<endl;
+	
+	// Serve, a line at a time
+	string line;
+	long lines = 0;
+	char buf[256];
+	while (!quit) {
+		struct pollfd pfd;
+		pfd.fd = port;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, -1) <= 0) continue;
+		int n = read(port, buf, sizeof(buf));
+		if (n <= 0) {
+			if (n < 0 && errno != EAGAIN && errno != EINTR) usleep(100000); // No slave
+			continue;
+		}
+		double t = now();
+		if (isnan(start)) start = t;
+		for (int i=0; i<n && !quit; ++i) {
+			char c = buf[i];
+			if (byte_time > 0) {
+				rx_free = max(rx_free, t) + byte_time;
+				sleep_until(rx_free);
+			}
+			if (iEcho) send(&c, 1);
+			if (c == '\r') continue;
+			if (c != '\n') {
+				line += c;
+				continue;
+			}
+			
+			// Empty lines only get the prompt
+			if (line.find_first_not_of(' ') == string::npos) {
+				if (iEcho) send(">", 1);
+				line.clear();
+				continue;
+			}
+			if (latency > 0) sleep_until(now() + latency);
+			string r = bop_line(line);
+			if (iVerbose) cerr<<now()-start<<" "<<line<<" -> "<<r<<endl;
+			r += "\r\n";
+			if (iEcho) r += '>';
+			send(r);
+			line.clear();
+			++lines;
+		}
+	}
+	
+	if (iLink) unlink(argv[iLink]);
+	if (slave >= 0) close(slave);
+	close(port);
+	cout<<lines<<" lines served."<<endl;
+	return 0;
+}
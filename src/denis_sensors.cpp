@@ -20,79 +20,211 @@
 #include <unistd.h>
 #include "denis_sensors.h"
 #include <cstdlib>
-#include <vector>
-#include "straux.h"
+#include <cstring>
 #include <cmath>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <time.h>
 
-bool denis_sensors::read(double *G, double *T1, double *T2) {
-	if (!*this) return true;
+static int64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return int64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+denis_sensors::denis_sensors() : opened(false), nconnects(0), nfailures(0), nstale(0), timeout(1000), period(200), maxAge(2000) {
+	memset(&addr, 0, sizeof(addr));
+	wake[0] = wake[1] = -1;
+}
+
+bool denis_sensors::open(uint32_t IP, uint16_t port) {
+	close();
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = IP;
+	addr.sin_port = htons(port);
 	
-	// Default to NAN
-	if (G ) *G  = NAN;
-	if (T1) *T1 = NAN;
-	if (T2) *T2 = NAN;
+	if (pipe(wake)) return false;
+	sigset_t block, old;
+	sigfillset(&block);
+	pthread_sigmask(SIG_BLOCK, &block, &old); // Signals are for the main thread
+	int e = pthread_create(&tid, 0, worker, this);
+	pthread_sigmask(SIG_SETMASK, &old, 0);
+	if (e) {
+		::close(wake[0]);
+		::close(wake[1]);
+		wake[0] = wake[1] = -1;
+		return false;
+	}
+	opened = true;
 	
-	// Create and connect the socket
+	// Test run
+	sensor_sample s;
+	for (int64_t end = now_ns() + int64_t(timeout)*1000000; !latest.load(s) && now_ns() < end; )
+		usleep(10000);
+	if (!latest.load(s)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool denis_sensors::open(const char *address, uint16_t port) {
+	struct addrinfo hints, *ai;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(address, 0, &hints, &ai)) return false;
+	uint32_t IP = ((sockaddr_in*)ai->ai_addr)->sin_addr.s_addr;
+	freeaddrinfo(ai);
+	return open(IP, port);
+}
+
+void denis_sensors::close() {
+	if (!opened) return;
+	char c = 0;
+	if (write(wake[1], &c, 1)) {}
+	pthread_join(tid, 0);
+	::close(wake[0]);
+	::close(wake[1]);
+	wake[0] = wake[1] = -1;
+	opened = false;
+}
+
+bool denis_sensors::read(sensor_sample &s) const {
+	if (!latest.load(s)) {
+		s.G = s.T1 = s.T2 = NAN;
+		return false;
+	}
+	return now_ns() - s.t <= int64_t(maxAge)*1000000;
+}
+
+bool denis_sensors::read(double *G, double *T1, double *T2) {
+	sensor_sample s;
+	bool fresh = read(s);
+	if (!fresh && opened) ++nstale;
+	if (G ) *G  = s.G;
+	if (T1) *T1 = s.T1;
+	if (T2) *T2 = s.T2;
+	return fresh;
+}
+
+bool denis_sensors::pause(int ms) {
+	struct pollfd p;
+	p.fd = wake[0];
+	p.events = POLLIN;
+	while (poll(&p, 1, ms) < 0 && errno == EINTR);
+	return p.revents;
+}
+
+int denis_sensors::connectSocket() {
 	int s = socket(AF_INET, SOCK_STREAM, 0);
-	if (s==-1) {
+	if (s == -1) {
 		debug_say("Failed to create socket.");
-		return false;
+		return -1;
 	}
-	if (connect(s, (sockaddr*)&addr, sizeof(addr))) {
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	if (connect(s, (sockaddr*)&addr, sizeof(addr)) && errno != EINPROGRESS) {
 		debug_say("Failed to connect socket.");
-		return false;
+		::close(s);
+		return -1;
 	}
 	
-	// Prepare for reading data
-/*	fd_set set;
-	FD_ZERO(&set);
-	FD_SET(s, &set);
-	timeval timeout;
-	timeout.tv_sec=0;
-	timeout.tv_usec=500000;
-	do {
-		int i=select(s+1, &set, 0, 0, &timeout);
-		if (i<0) {
-			if (errno = EINTR) continue;
-			return true;
+	// Wait for it, or to stop
+	struct pollfd p[2];
+	p[0].fd = s;
+	p[0].events = POLLOUT;
+	p[1].fd = wake[0];
+	p[1].events = POLLIN;
+	int e = 0;
+	socklen_t n = sizeof(e);
+	if (poll(p, 2, timeout) <= 0 || p[1].revents ||
+		getsockopt(s, SOL_SOCKET, SO_ERROR, &e, &n) || e) {
+		debug_say("Failed to connect socket.");
+		::close(s);
+		return -1;
+	}
+	return s;
+}
+
+void *denis_sensors::worker(void *self) {
+	denis_sensors &d = *(denis_sensors*)self;
+	int backoff = 100;
+	for (;;) {
+		int s = d.connectSocket();
+		bool good = false;
+		if (s >= 0) {
+			++d.nconnects;
+			
+			// Lines until the box closes, goes silent, or we stop
+			char data[1024];
+			int n = 0;
+			for (;;) {
+				struct pollfd p[2];
+				p[0].fd = s;
+				p[0].events = POLLIN;
+				p[1].fd = d.wake[0];
+				p[1].events = POLLIN;
+				int i = poll(p, 2, d.timeout);
+				if (i < 0 && errno == EINTR) continue;
+				if (i <= 0 || p[1].revents) break;
+				int r = ::read(s, data+n, sizeof(data)-1-n);
+				if (r < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+				if (r <= 0) break;
+				
+				// Denis might have sent me data using UTF16....
+				for (int k=n, end=n+r; k<end; ++k) if (data[k]) data[n++] = data[k];
+				
+				char *b = data, *e;
+				while ((e = (char*)memchr(b, '\n', data+n-b))) {
+					*e = 0;
+					if (d.parse(b)) good = true;
+					b = e+1;
+				}
+				n -= b-data;
+				memmove(data, b, n);
+				if (n == int(sizeof(data))-1) n = 0; // No line in sight, drop it
+			}
+			::close(s);
 		}
-		if (!i) return true;
-	} while (false);*/
-	
-	// Read data
-	char data[1024];
-	int n = 0;
-	do {
-		int d = ::read(s, data+n, 1024-n);
-		if (d<=0) {
-			debug_say("Failed to read from socket.");
-			return false;
+		
+		if (good) {
+			backoff = 100;
+			if (d.pause(d.period)) break;
+		} else {
+			++d.nfailures;
+			if (d.pause(backoff)) break;
+			backoff = backoff*2 > 5000 ? 5000 : backoff*2;
 		}
-		n += d;
-	} while (data[n-1] != '\n');
-	close(s);
-	data[n-1] = 0;
-	
-	// Denis might have sent me data using UTF16....
-	if (data[0] == 0) {
-		for (int i=0; i<n/2; ++i)
-			data[i] = data[2*i+1];
-		n = n/2;
 	}
-	
-	// Split the string into a vector
-	std::vector<std::string> v = strSplit(data, ' ');
-	if (v.size() < 5) {
+	return 0;
+}
+
+bool denis_sensors::parse(char *line) {
+	double v[3];
+	int fields = 0;
+	char *save;
+	for (char *tok = strtok_r(line, " \t\r", &save); tok; tok = strtok_r(0, " \t\r", &save)) {
+		if (fields < 3) {
+			char *end;
+			v[fields] = strtod(tok, &end);
+			if (end == tok) break;
+		}
+		++fields;
+	}
+	if (fields < 5) {
 		debug_say("Bad data read from socket.");
-		debug_dump(n);
-		debug_dump(v.size());
-		debug_dump(data);
+		debug_dump(fields);
 		return false;
 	}
 	
-	if (G ) *G  = std::atof(v[0].c_str());
-	if (T1) *T1 = std::atof(v[1].c_str());
-	if (T2) *T2 = std::atof(v[2].c_str());
-	
+	sensor_sample s;
+	s.G  = v[0];
+	s.T1 = v[1];
+	s.T2 = v[2];
+	s.t  = now_ns();
+	latest.store(s);
 	return true;
 }
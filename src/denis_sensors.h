@@ -21,32 +21,67 @@
 #define READ_DENIS_SENSORS_H
 
 #include <stdint.h>
+#include <atomic>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include "seqlock.h"
 #include "debug.h"
 
+// One reading of the sensor box
+struct sensor_sample {
+	double G;    // Insolation, W/m2
+	double T1;   // Temperatures, C
+	double T2;
+	int64_t t;   // When received, CLOCK_MONOTONIC ns
+};
+
+// Client of the sensor box, which sends lines of "G T1 T2 x y" over TCP,
+// one per connection or a stream of them. A thread of its own keeps the
+// connection up, and reconnects with a growing delay (100ms to 5s) when it
+// fails, and the latest reading goes to a seqlock. read() costs a copy, and
+// never waits on the network.
 class denis_sensors {
 	sockaddr_in addr;
+	bool opened;
+	pthread_t tid;
+	int wake[2];                // Pipe, written to stop the thread
+	seqlock<sensor_sample> latest;
+	std::atomic<long> nconnects, nfailures, nstale;
 	
+	static void *worker(void *self);
+	int connectSocket();        // Connected socket, or -1
+	bool pause(int ms);         // True when told to stop
+	bool parse(char *line);     // Publishes a line, false if not a reading
+	
+	// Non-copyable
+	denis_sensors(const denis_sensors &);
+	denis_sensors &operator=(const denis_sensors &);
+
 public:
+	int timeout;  // Connecting, and longest silence of a connection, ms
+	int period;   // Wait to reconnect after the box closes a good connection, ms
+	int maxAge;   // Readings older than this are stale, ms
+	
+	denis_sensors();
+	~denis_sensors() { close(); }
+	
+	// Starts the client, and waits up to timeout for a reading. Returns
+	// false, with the client stopped, if none comes.
+	bool open(uint32_t IP, uint16_t port = 1800); // IP in network order, port in host order
+	bool open(const char *address, uint16_t port = 1800);
+	void close();
+	operator bool () const { return opened; }
+	
+	// Latest reading. Returns false, and NANs, before the first one, and
+	// false, with the last one, while stale.
 	bool read(double *G, double *T1, double *T2);
-	bool open(uint32_t IP, uint16_t port = htons(1800)) {
-		// Sensor address specified, set connection parameters
-		addr.sin_family = AF_INET;
-		addr.sin_addr.s_addr = IP;
-		
-		// Test run
-		if (!read(0,0,0)) {
-			addr.sin_addr.s_addr = 0;
-			return false;
-		}
-		return true;
-	}
-	bool open(const char *address, uint16_t port = htons(1800)) {
-		return open(inet_addr(address), port);
-	}
-	operator bool () const { return addr.sin_addr.s_addr; }
+	bool read(sensor_sample &s) const;
+	
+	long connects() const { return nconnects; }
+	long failures() const { return nfailures; }
+	long stale() const { return nstale; }  // read() calls that found stale readings
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,288 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/***************************************************************************
+ *   Embedded tracker benchmark: runs the IncCond, temperature and MLAM    *
+ *   trackers in double, float and Q16.16 fixed point on a simulated       *
+ *   generator, over the same stimuli as mppt, and compares the energy     *
+ *   each harvests and the CPU cycles each takes per step.                 *
+ *                                                                         *
+ *   Temperatures are in Celsius, except for pvGenerator (KELVIN).         *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "arg_tool.h"
+#include "rdtsc.h"
+#include "load_dat.h"
+#include "fixedpoint.h"
+#include "mppt_inccond.h"
+#include "mppt_temperaturehf.h"
+#include "mppt_mlamhf.h"
+#include "mppt_mlam_embedded.h"
+#include "pvgen_sc.h"
+#include "pvgen_setup.h"
+#include "pvgen_models.h"
+#include "pvgen_nominal_model.h"
+
+using namespace std;
+
+int iHelp, iStimuli, iGenerator, skip_boot;
+arg_t args[] = {
+	{"-h",                &iHelp,      ARG_FLAG},
+	{"--help",            &iHelp,      ARG_FLAG},
+	{"--stimuli",         &iStimuli,   ARG_DEFAULT},
+	{"--generator-model", &iGenerator, ARG_DEFAULT},
+	{"--skip-boot",       &skip_boot,  ARG_FLAG},
+	{0,0,0}
+};
+
+static vector<double> Time, G, TK;
+static pvGenerator_sc gen;
+
+// Stimuli time in which energy is not accounted, with --skip-boot.
+static const double boot_time = 100;
+
+struct result {
+	string name;
+	double W;       // Energy harvested, J
+	double cycles;  // Per step
+	double maperr;  // Worst map lookup error against double, V, or NaN
+	size_t mem;     // Map memory, bytes
+};
+static vector<result> results;
+
+// Runs trk on the generator over the stimuli, in closed loop, then times it
+// on the inputs recorded in the first run. step(trk, V, I, T) is one step,
+// with T in Kelvin when kelvin is set, in Celsius otherwise.
+template <typename real, typename tracker_t, typename step_t>
+static result run(const char *name, const tracker_t &trk0, step_t step, bool kelvin) {
+	result r;
+	r.name = name;
+	r.maperr = NAN;
+	r.mem = 0;
+	
+	tracker_t trk = trk0;
+	vector<real> rV, rI, rT;
+	rV.reserve(Time.size());
+	rI.reserve(Time.size());
+	rT.reserve(Time.size());
+	double V = 0.5, W = 0, Pa = 0;
+	for (size_t i=0; i<Time.size(); ++i) {
+		gen.setInsolation(G[i]);
+		gen.setTemperature(TK[i]);
+		double I = gen.I(V);
+		double P = V*I;
+		
+		// Measurements, as the target would see them
+		rV.push_back(real(V));
+		rI.push_back(real(I));
+		rT.push_back(real(kelvin ? TK[i] : TK[i] - 273.16));
+		double Vr = double(step(trk, rV.back(), rI.back(), rT.back()));
+		
+		if (i && (!skip_boot || Time[i] > boot_time))
+			W += (Time[i]-Time[i-1]) * (P+Pa)/2;
+		V = Vr;
+		Pa = P;
+	}
+	r.W = W;
+	
+	// Cycles per step, best of a few runs
+	int n = rV.size();
+	int rounds = 1 + 400000/n;
+	double s = 0, best = HUGE_VAL;
+	for (int k=0; k<5; ++k) {
+		timestamp t0 = read_timestamp_counter();
+		for (int j=0; j<rounds; ++j) {
+			trk = trk0;
+			for (int i=0; i<n; ++i) s += double(step(trk, rV[i], rI[i], rT[i]));
+		}
+		timestamp t1 = read_timestamp_counter();
+		best = min(best, double(t1-t0)/(double(rounds)*n));
+	}
+	volatile double sink = s;
+	(void)sink;
+	r.cycles = best;
+	return r;
+}
+
+// Worst error of an embedded map against the double precision one, at the
+// stimuli operating points of the reference run.
+template <typename real>
+static double map_error(const mppt_mlam &ref, const mppt_mlam_embedded<real> &m) {
+	double emax = 0;
+	for (size_t i=0; i<Time.size(); ++i) {
+		gen.setInsolation(G[i]);
+		gen.setTemperature(TK[i]);
+		double I = gen.getSourceCurrent();
+		for (int k=0; k<8; ++k) {
+			double Ik = I*k/8, T = TK[i] - 273.16;
+			double e = fabs(double(m(real(Ik), real(T))) - ref(Ik, T));
+			if (!(e <= emax)) emax = e;
+		}
+	}
+	return emax;
+}
+
+template <typename real>
+static real step_ic(mppt_inccond_t<real> &t, real V, real I, real) { return t(V, I); }
+template <typename real>
+static real step_temp(mppt_temperaturehf_t<real> &t, real V, real I, real T) { return t(V, I, T); }
+template <typename real>
+static real step_mlam(mppt_mlamhf_embedded<real> &t, real V, real I, real T) { return t(V, I, T); }
+static double step_mlam_ref(mppt_mlamhf &t, double V, double I, double T) { return t(V, I, T); }
+
+template <typename real>
+static void run_ic(const char *name, const mppt_inccond &ref) {
+	mppt_inccond_t<real> t;
+	t.dVr = real(ref.dVr);
+	results.push_back(run<real>(name, t, step_ic<real>, true));
+}
+
+template <typename real>
+static void run_temp(const char *name, const mppt_temperaturehf &ref) {
+	mppt_temperaturehf_t<real> t;
+	t.Vmpref = real(ref.Vmpref);
+	t.Tref   = real(ref.Tref);
+	t.kVT    = real(ref.kVT);
+	t.dVr    = real(ref.dVr);
+	results.push_back(run<real>(name, t, step_temp<real>, true));
+}
+
+template <typename real>
+static void run_mlam(const char *name, const mppt_mlamhf &ref) {
+	mppt_mlamhf_embedded<real> t(bilinear_table<real>(*ref.getMap()));
+	t.dVr = real(ref.dVr);
+	result r = run<real>(name, t, step_mlam<real>, false);
+	r.maperr = map_error<real>(ref, t);
+	r.mem = t.map.memory();
+	results.push_back(r);
+}
+
+static void print(const result &r, const result &ref) {
+	cout<<setiosflags(ios::left)<<setw(22)<<r.name<<resetiosflags(ios::left);
+	cout<<fixed;
+	cout<<setw(14)<<setprecision(1)<<r.W;
+	cout<<setw(10)<<setprecision(3)<<100*r.W/ref.W;
+	cout<<setw(9)<<setprecision(1)<<r.cycles;
+	if (isnan(r.maperr)) cout<<setw(11)<<"-"<<setw(9)<<"-";
+	else cout<<setw(11)<<setprecision(3)<<1e3*r.maperr<<setw(9)<<r.mem;
+	cout<<endl;
+}
+
+int main(int argc, const char *argv[]) {
+	if (arg_eval(argc, argv, args)) {
+		cerr<<"Error: Command line parsing failed."<<endl;
+		return 1;
+	}
+	if (iHelp || !iStimuli) {
+		cout<<"Usage: embench --stimuli FILE [--generator-model NAME] [--skip-boot]"<<endl;
+		cout<<"Runs the trackers of mppt in double, float and Q16.16 fixed point on"<<endl;
+		cout<<"a simulated generator, and reports energy harvested, relative to the"<<endl;
+		cout<<"double precision tracker, CPU cycles per step, and for MLAM the worst"<<endl;
+		cout<<"map error against double precision and the map memory."<<endl;
+		return iHelp ? 0 : 1;
+	}
+	
+	cout<<"<< Embedded tracker benchmark >>"<<endl;
+	
+	const pvGenerator::parameters_t *genparam = &generators[GEN_KC130TM];
+	if (iGenerator) {
+		genparam = generator_by_name(argv[iGenerator]);
+		if (!genparam) {
+			cerr<<"Error: Unknown generator model \""<<argv[iGenerator]<<"\"."<<endl;
+			return 1;
+		}
+	}
+	
+	// Stimuli
+	ifstream in(argv[iStimuli]);
+	std::map<std::string, std::vector<double> > stimuli = load_dat(in);
+	if (stimuli["Time"].empty() || stimuli["G"].empty() || stimuli["T"].empty()) {
+		cerr<<"Error: Stimuli file does not contain required variables Time, G and/or T."<<endl;
+		return 1;
+	}
+	Time = stimuli["Time"];
+	G    = stimuli["G"];
+	for (size_t i=0; i<stimuli["T"].size(); ++i) {
+		double T = stimuli["T"][i];
+		TK.push_back(T > 200 ? T : T + 273.16);
+	}
+	pvgen_setup(gen, genparam->model);
+	
+	// Trackers, as set up by mppt.cpp
+	mppt_inccond ic;
+	
+	mppt_temperaturehf temp;
+	temp.Vmpref = genparam->nameplate.Vmp;
+	temp.Tref   = genparam->nameplate.Tr;
+	temp.kVT    = genparam->nameplate.kT_Voc;
+	temp.dVr    = 0.01;
+	
+	mppt_mlamhf mlam;
+	pvGenerator::model_parameters_t m = pvgen_nominal_model(genparam->nameplate);
+	m.Rs += 0.16;
+	mlam.Iphr = m.Iph * 1000/m.G;
+	mlam.mr   = m.m;
+	mlam.Ior  = m.I0;
+	mlam.Rs   = m.Rs;
+	mlam.Rp   = m.Rp;
+	mlam.Tr   = m.T - 273.16;
+	mlam.Ns   = m.Ns;
+	mlam.dVr  = 0.01;
+	mlam.setMap(0, mlam.Iphr*1.5, 128, 25, 100, 4);
+	if (!mlam.getMap()) {
+		cerr<<"Error: Failed to configure MPPT trackers."<<endl;
+		return 1;
+	}
+	
+	cout<<"Generator "<<genparam->name<<", "<<Time.size()<<" steps."<<endl;
+	cout<<"Tracker                 Energy (J)  Rel. (%)   Cycles  Map (mV)  Map (B)"<<endl;
+	
+	results.push_back(run<double>("inccond double", ic, step_ic<double>, true));
+	run_ic<float >("inccond float", ic);
+	run_ic<q16_16>("inccond q16.16", ic);
+	for (size_t i=0; i<results.size(); ++i) print(results[i], results[0]);
+	results.clear();
+	
+	results.push_back(run<double>("temp+ic double", temp, step_temp<double>, true));
+	run_temp<float >("temp+ic float", temp);
+	run_temp<q16_16>("temp+ic q16.16", temp);
+	for (size_t i=0; i<results.size(); ++i) print(results[i], results[0]);
+	results.clear();
+	
+	result ref = run<double>("mlam+ic double", mlam, step_mlam_ref, false);
+	ref.maperr = 0;
+	ref.mem = mlam.memory();
+	results.push_back(ref);
+	run_mlam<double>("mlam+ic double table", mlam);
+	run_mlam<float >("mlam+ic float", mlam);
+	run_mlam<q16_16>("mlam+ic q16.16", mlam);
+	for (size_t i=0; i<results.size(); ++i) print(results[i], results[0]);
+	
+	return 0;
+}
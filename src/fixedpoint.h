@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include <stdint.h>
+#include <cmath>
+
+// Signed 32-bit fixed point with F fractional bits, Q(31-F).F, as found on
+// DSPs and MCUs without an FPU. Products and quotients go through 64 bits,
+// and every operation saturates instead of wrapping around, division by zero
+// included. Layout is a plain int32_t, so tables of raw values exported as
+// int32_t may be used in place.
+template <int F>
+class qfix {
+	int32_t v;
+	
+	static int32_t sat(int64_t x) {
+		if (x > INT32_MAX) return INT32_MAX;
+		if (x < INT32_MIN) return INT32_MIN;
+		return int32_t(x);
+	}
+	
+	public:
+	static const int frac_bits = F;
+	
+	qfix() : v(0) {}
+	qfix(int i) : v(sat(int64_t(i) << F)) {}
+	qfix(double d) : v(sat(std::llround(d * double(int64_t(1) << F)))) {}
+	static qfix fromRaw(int32_t r) { qfix q; q.v = r; return q; }
+	
+	int32_t raw() const { return v; }
+	explicit operator double() const { return v / double(int64_t(1) << F); }
+	explicit operator float() const { return float(double(*this)); }
+	// Integer part, rounded towards zero like a cast from double.
+	int trunc() const { return v >= 0 ? v >> F : -(-int64_t(v) >> F); }
+	
+	qfix operator - () const { return fromRaw(sat(-int64_t(v))); }
+	qfix operator + (qfix o) const { return fromRaw(sat(int64_t(v) + o.v)); }
+	qfix operator - (qfix o) const { return fromRaw(sat(int64_t(v) - o.v)); }
+	qfix operator * (qfix o) const { return fromRaw(sat((int64_t(v) * o.v) >> F)); }
+	qfix operator / (qfix o) const {
+		if (!o.v) return fromRaw(v > 0 ? INT32_MAX : v < 0 ? INT32_MIN : 0);
+		return fromRaw(sat((int64_t(v) << F) / o.v));
+	}
+	qfix &operator += (qfix o) { return *this = *this + o; }
+	qfix &operator -= (qfix o) { return *this = *this - o; }
+	qfix &operator *= (qfix o) { return *this = *this * o; }
+	qfix &operator /= (qfix o) { return *this = *this / o; }
+	
+	bool operator == (qfix o) const { return v == o.v; }
+	bool operator != (qfix o) const { return v != o.v; }
+	bool operator <  (qfix o) const { return v <  o.v; }
+	bool operator >  (qfix o) const { return v >  o.v; }
+	bool operator <= (qfix o) const { return v <= o.v; }
+	bool operator >= (qfix o) const { return v >= o.v; }
+};
+
+typedef qfix<16> q16_16;
+
+// Integer part, rounded towards zero, for any of the numeric types above.
+inline int trunc_int(double x) { return int(x); }
+inline int trunc_int(float x)  { return int(x); }
+template <int F> inline int trunc_int(qfix<F> x) { return x.trunc(); }
+
+#endif
@@ -1,95 +1,146 @@
-#include "kepco.h"
-#include <cstdlib>
-
-void kepco_bop::clearError() {
-	char ch=0;
-	serial.putch('\n');
-	do {
-		if (serial.getch(ch)) serial.putch('\n');
-	} while (ch!='>');
-}
-
-std::string kepco_bop::exchange(std::string cmd) {
-	if (!status) return "ERROR (Not connected)";
-	
-	// Send the command and check the echo
-	int i=0;
-	char ch;
-	cmd += '\n';
-	if (echoed) {
-		serial.putch(cmd[i++]); // Sends the first byte before the loop
-		do {
-			serial.putch(cmd[i]); // Sends a new byte (while receiving the previous echo)
-			if (serial.getch(ch)) return "TIMEOUT (ECHO)";
-			if (ch!=cmd[i-1]) return "ERROR (ECHO)";
-		} while (++i!=cmd.length()); // len is always 1+, as a '\n' is added.
-		if (serial.getch(ch)) return "TIMEOUT (ECHO)"; // Gets the last byte
-		if (ch!=cmd[i-1]) return "ERROR (ECHO)";
-	} else serial.write(cmd);
-	
-	// Reads the response std::string
-	std::string r;
-	do {
-		if (serial.getch(ch)) return "TIMEOUT (RESPONSE)";
-		if (ch==0x11 || ch==0x13 || ch=='\r') continue; // XON and XOFF and LF
-		r += ch;
-	} while (ch!='\n');
-	if (echoed) {
-		do {
-			if (serial.getch(ch)) return "TIMEOUT (RESPONSE)";
-		} while (ch!='>');
-	}
-	if (r.length()==0) return "";
-	return std::string(r,0,r.length()-1);
-}
-
-std::string kepco_bop::float_to_string(double v) {
-	const char conv[] = "0123456789";
-	std::string s;
-	if (v<0) { s='-'; v*=-1; }
-	int i = int(1000*v+.5);
-	s += conv[i/10000%10];//=='0' ? ' ' : conv[i/10000%10];
-	s += conv[i/1000 %10];
-	s += '.';
-	s += conv[i/100  %10];
-	s += conv[i/10   %10];
-	s += conv[i/1    %10];
-	return s;
-}
-
-bool kepco_bop::open(std::string device, int baud) {
-	serial.setPort(device);
-	serial.setBaudRate(baud);
-	serial.setParity(serialHandler::prNone);
-	serial.setWriteTimeouts(2,200);
-	serial.setReadTimeouts(100,2,200);
-	serial.Connect();
-	status=false;
-	echoed=false;
-	if (serial.Connected()) {
-		// Check whether the power supply is echoed
-		string s;
-		while (!serial.getline(s)); // Read until timeout
-		serial.putch('\n');
-		while (!serial.getline(s)); // Read until timeout
-		debug_dump_vector(s, s.length(), DEBUG_DUMP_CHAR_AS_HEX);
-		echoed = s==">";
-		
-		status = true;
-		s = exchange("*rst;*idn?");
-		status = false;
-		debug_dump(echoed);
-		debug_dump(s);
-		if      (s=="KEPCO BOP BIT232 REV. 3.1") status = true;
-		else if (s=="KEPCO,BOP1KW 50-20 ,E156884, 2.01") status = true;
-		else {
-			serial.Disconnect();
-		}
-		lasterror = s;
-	} else {
-		lasterror="Serial connection failed.";
-	}
-	exchange("syst:rem on");
-	exchange("outp on");
-	return status;
-}
+#include "kepco.h"
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+
+void kepco_bop::clearError() {
+	char ch=0;
+	serial.putch('\n');
+	do {
+		if (serial.getch(ch)) serial.putch('\n');
+	} while (ch!='>');
+}
+
+const char *kepco_bop::exchange(const char *cmd, int n) {
+	if (!status) return "ERROR (Not connected)";
+	if (n > KEPCO_LINE_MAX) return "ERROR (Command too long)";
+	
+	// Send the command and check the echo
+	int i=0;
+	char ch;
+	std::memcpy(tx, cmd, n);
+	tx[n++] = '\n';
+	if (echoed && byte_echo) {
+		serial.putch(tx[i++]); // Sends the first byte before the loop
+		do {
+			serial.putch(tx[i]); // Sends a new byte (while receiving the previous echo)
+			if (serial.getch(ch)) return "TIMEOUT (ECHO)";
+			if (ch!=tx[i-1]) return "ERROR (ECHO)";
+		} while (++i!=n); // n is always 1+, as a '\n' is added.
+		if (serial.getch(ch)) return "TIMEOUT (ECHO)"; // Gets the last byte
+		if (ch!=tx[i-1]) return "ERROR (ECHO)";
+	} else {
+		if (serial.write(tx, n)) return "TIMEOUT (WRITE)";
+		if (echoed) {
+			// The whole echo, as a line
+			int e = serial.readLine(rx, sizeof(rx));
+			if (e < 0) return "TIMEOUT (ECHO)";
+			e = strip_flow_control(rx, e);
+			if (e+1!=n || std::memcmp(rx, tx, e)) return "ERROR (ECHO)";
+		}
+	}
+	
+	// Reads the response
+	int r = serial.readLine(rx, sizeof(rx));
+	if (r < 0) return "TIMEOUT (RESPONSE)";
+	strip_flow_control(rx, r);
+	if (echoed) {
+		do {
+			if (serial.getch(ch)) return "TIMEOUT (RESPONSE)";
+		} while (ch!='>');
+	}
+	return rx;
+}
+
+// Drops XON and XOFF, returns the new length
+int kepco_bop::strip_flow_control(char *s, int n) {
+	int j=0;
+	for (int i=0; i<n; ++i) {
+		if (s[i]!=0x11 && s[i]!=0x13) s[j++] = s[i];
+	}
+	s[j] = 0;
+	return j;
+}
+
+std::string kepco_bop::float_to_string(double v, int digits) {
+	scpi_line l;
+	l.number(v, digits);
+	return l.c_str();
+}
+
+int kepco_bop::parse_reals(const char *s, double *v, int n) {
+	int k;
+	for (k=0; k<n; ++k) {
+		while (*s==' ') ++s;
+		if (*s=='+') ++s;
+		const char *e = s;
+		while (*e && *e!=';') ++e;
+		const char *f = e;
+		while (f>s && f[-1]==' ') --f;
+		std::from_chars_result r = std::from_chars(s, f, v[k]);
+		if (r.ec != std::errc() || r.ptr != f) break;
+		if (!*e) return k+1;
+		s = e+1;
+	}
+	return k;
+}
+
+scpi_line &scpi_line::operator << (const char *s) {
+	while (*s && len < KEPCO_LINE_MAX) buf[len++] = *s++;
+	if (*s) full = true;
+	buf[len] = 0;
+	return *this;
+}
+
+scpi_line &scpi_line::operator << (char c) {
+	if (len < KEPCO_LINE_MAX) buf[len++] = c;
+	else full = true;
+	buf[len] = 0;
+	return *this;
+}
+
+scpi_line &scpi_line::number(double v, int digits) {
+	if (v == 0) v = 0; // No "-0.000"
+	std::to_chars_result r = std::to_chars(buf+len, buf+KEPCO_LINE_MAX, v, std::chars_format::fixed, digits);
+	if (r.ec != std::errc()) full = true;
+	else len = r.ptr - buf;
+	buf[len] = 0;
+	return *this;
+}
+
+bool kepco_bop::open(std::string device, int baud) {
+	serial.setPort(device);
+	serial.setBaudRate(baud);
+	serial.setParity(serialHandler::prNone);
+	serial.setWriteTimeouts(2,200);
+	serial.setReadTimeouts(100,2,200);
+	serial.Connect();
+	status=false;
+	echoed=false;
+	if (serial.Connected()) {
+		// Check whether the power supply is echoed
+		string s;
+		while (!serial.getline(s)); // Read until timeout
+		serial.putch('\n');
+		while (!serial.getline(s)); // Read until timeout
+		debug_dump_vector(s, s.length(), DEBUG_DUMP_CHAR_AS_HEX);
+		echoed = s==">";
+		
+		status = true;
+		s = exchange("*rst;*idn?");
+		status = false;
+		debug_dump(echoed);
+		debug_dump(s);
+		if      (s=="KEPCO BOP BIT232 REV. 3.1") status = true;
+		else if (s=="KEPCO,BOP1KW 50-20 ,E156884, 2.01") status = true;
+		else {
+			serial.Disconnect();
+		}
+		lasterror = s;
+	} else {
+		lasterror="Serial connection failed.";
+	}
+	exchange("syst:rem on");
+	exchange("outp on");
+	return status;
+}
@@ -1,102 +1,171 @@
-#ifndef KEPCO_H
-#define KEPCO_H
-
-#include <string>
-#include <cmath>
-#include <cstdlib>
-#include "straux.h"
-#include "serial.h"
-
-//#define DEBUG
-#include "debug.h"
-
-class kepco_bop {
-	serialHandler serial;
-	bool status; //true=ok, false=error
-	std::string lasterror;
-	bool echoed;
-	
-	static std::string float_to_string(double v);
-	public:
-	std::string exchange(std::string cmd);
-	void clearError();
-	std::string getLastError() {
-		std::string s = lasterror;
-		lasterror="";
-		return s;
-	}
-	
-	operator bool () const { return status; }
-	
-	bool reset() {
-//		clearError();
-		lasterror = exchange("*rst");
-		return lasterror != "";
-	}
-	bool setVoltage(double v) {
-		lasterror=exchange("volt " + float_to_string(v));
-		return lasterror != "";
-	}
-	bool setCurrent(double i) {
-		lasterror=exchange("curr " + float_to_string(i));
-		return lasterror != "";
-	}
-	bool setVoltageAndCurrent(double v, double i) {
-		lasterror=exchange("volt " + float_to_string(v) + ";curr " + float_to_string(i));
-		return lasterror != "";
-	}
-	bool currentMode() {
-		lasterror=exchange("func:mode curr");
-		return lasterror != "";
-	}
-	bool voltageMode() {
-		lasterror=exchange("func:mode volt");
-		return lasterror != "";
-	}
-	double getVoltage() {
-		std::string s = exchange("meas:volt?");
-		if (!strIsFloat(s)) {
-			lasterror = s;
-			return NAN;
-		}
-		return std::atof(s.c_str());
-	}
-	double getCurrent() {
-		std::string s = exchange("meas:curr?");
-		if (!strIsFloat(s)) {
-			lasterror = s;
-			return NAN;
-		}
-		return std::atof(s.c_str());
-	}
-	bool getVoltageAndCurrent(double &v, double &i) {
-		std::string s = exchange("meas:volt?;curr?");
-		int n;
-		for (n=0; s[n]!=';' && n<s.length(); ++n);
-		if (n+1>=s.length()) {
-			lasterror = "Expected \';\', not found.";
-			return true; // Erro
-		}
-		v = std::atof(std::string(s,0,n).c_str());
-		i = std::atof(std::string(s,n+1).c_str());
-		return false;
-	}
-	string getName() {
-		return exchange("*idn?");
-	}
-	
-	bool open(std::string device, int baud=9600);
-	void close() {
-		if (status) reset();
-		serial.Disconnect();
-		status = false;
-	}
-	
-	kepco_bop() : status(false), echoed(false) {}
-	kepco_bop(std::string device, int baud=9600) : status(false), echoed(false) {
-		open(device, baud);
-	}
-	~kepco_bop() { close(); }
-};
-
-#endif
+#ifndef KEPCO_H
+#define KEPCO_H
+
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "straux.h"
+#include "serial.h"
+
+//#define DEBUG
+#include "debug.h"
+
+// Longest command or response line, without the '\n'
+#define KEPCO_LINE_MAX 255
+
+// A SCPI command line built in place, so that sending one allocates
+// nothing. What does not fit is dropped, and overflow() is set.
+class scpi_line {
+	char buf[KEPCO_LINE_MAX+1];
+	int len;
+	bool full;
+	
+	public:
+	scpi_line() : len(0), full(false) { buf[0] = 0; }
+	
+	void clear() { len = 0; full = false; buf[0] = 0; }
+	scpi_line &operator << (const char *s);
+	scpi_line &operator << (char c);
+	// A number in fixed notation, with digits after the point.
+	scpi_line &number(double v, int digits);
+	
+	const char *c_str() const { return buf; }
+	int length() const { return len; }
+	bool overflow() const { return full; }
+};
+
+class kepco_bop {
+	serialHandler serial;
+	bool status; //true=ok, false=error
+	std::string lasterror;
+	bool echoed;
+	
+	// Line buffers, the last response is kept in rx
+	char tx[KEPCO_LINE_MAX+2];
+	char rx[KEPCO_LINE_MAX+1];
+	scpi_line line;
+	
+	static int strip_flow_control(char *s, int n);
+	bool command(const scpi_line &l) {
+		lasterror = exchange(l.c_str(), l.length());
+		return lasterror != "";
+	}
+	
+	public:
+	// In echo mode, send a byte and check its echo before sending the
+	// next, as older firmware may need. Otherwise the whole line is sent at
+	// once and its echo checked as a line.
+	bool byte_echo;
+	
+	// Digits after the point in the numbers sent to the supply.
+	int precision;
+	
+	// SCPI number formatting, as sent to the supply.
+	static std::string float_to_string(double v, int digits=3);
+	
+	// Parses up to n numbers separated by ';' from s, into v. Returns how
+	// many, stopping at the first field that is not a number.
+	static int parse_reals(const char *s, double *v, int n);
+	
+	// Sends cmd[n] and returns the response, or an error message. The
+	// response is kept in a buffer of the supply, until the next exchange.
+	const char *exchange(const char *cmd, int n);
+	const char *exchange(const char *cmd) { return exchange(cmd, std::strlen(cmd)); }
+	std::string exchange(const std::string &cmd) { return exchange(cmd.c_str(), cmd.length()); }
+	void clearError();
+	std::string getLastError() {
+		std::string s = lasterror;
+		lasterror="";
+		return s;
+	}
+	
+	operator bool () const { return status; }
+	
+	// Records the serial traffic to t, as channel. Set before open().
+	void setTap(serial_tap *t, int channel) { serial.setTap(t, channel); }
+	
+	bool reset() {
+//		clearError();
+		lasterror = exchange("*rst");
+		return lasterror != "";
+	}
+	bool setVoltage(double v) {
+		line.clear();
+		line<<"volt ";
+		line.number(v, precision);
+		return command(line);
+	}
+	bool setCurrent(double i) {
+		line.clear();
+		line<<"curr ";
+		line.number(i, precision);
+		return command(line);
+	}
+	bool setVoltageAndCurrent(double v, double i) {
+		line.clear();
+		line<<"volt ";
+		line.number(v, precision);
+		line<<";curr ";
+		line.number(i, precision);
+		return command(line);
+	}
+	bool currentMode() {
+		lasterror=exchange("func:mode curr");
+		return lasterror != "";
+	}
+	bool voltageMode() {
+		lasterror=exchange("func:mode volt");
+		return lasterror != "";
+	}
+	double getVoltage() {
+		double v;
+		const char *s = exchange("meas:volt?");
+		if (parse_reals(s, &v, 1) != 1) {
+			lasterror = s;
+			return NAN;
+		}
+		return v;
+	}
+	double getCurrent() {
+		double i;
+		const char *s = exchange("meas:curr?");
+		if (parse_reals(s, &i, 1) != 1) {
+			lasterror = s;
+			return NAN;
+		}
+		return i;
+	}
+	bool getVoltageAndCurrent(double &v, double &i) {
+		double r[2];
+		const char *s = exchange("meas:volt?;curr?");
+		if (parse_reals(s, r, 2) != 2) {
+			lasterror = *s ? s : "Expected \';\', not found.";
+			return true; // Erro
+		}
+		v = r[0];
+		i = r[1];
+		return false;
+	}
+	string getName() {
+		return exchange("*idn?");
+	}
+	
+	bool open(std::string device, int baud=9600);
+	void close() {
+		if (status) reset();
+		serial.Disconnect();
+		status = false;
+	}
+	
+	kepco_bop() : status(false), echoed(false), byte_echo(false), precision(3) {
+		lasterror.reserve(KEPCO_LINE_MAX);
+	}
+	kepco_bop(std::string device, int baud=9600) : status(false), echoed(false), byte_echo(false), precision(3) {
+		lasterror.reserve(KEPCO_LINE_MAX);
+		open(device, baud);
+	}
+	~kepco_bop() { close(); }
+};
+
+#endif
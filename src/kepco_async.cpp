@@ -0,0 +1,140 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "kepco_async.h"
+#include <cstring>
+#include <cerrno>
+#include <signal.h>
+#include <sched.h>
+
+kepco_async::kepco_async(kepco_bop &p) : psu(p), running(false), op(OP_NONE), Vset(0), Vm(0), Im(0), batch(0), failed(false) {
+	sem_init(&go, 0, 0);
+	sem_init(&done, 0, 0);
+}
+
+kepco_async::~kepco_async() {
+	stop();
+	sem_destroy(&go);
+	sem_destroy(&done);
+}
+
+bool kepco_async::start(int priority) {
+	if (running) return true;
+	
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	int e = 0;
+	if (priority > 0) {
+		struct sched_param sp;
+		memset(&sp, 0, sizeof(sp));
+		sp.sched_priority = priority;
+		e = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		if (!e) e = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		if (!e) e = pthread_attr_setschedparam(&attr, &sp);
+	}
+	
+	// Signals are for the main thread
+	sigset_t block, old;
+	sigfillset(&block);
+	pthread_sigmask(SIG_BLOCK, &block, &old);
+	if (!e) e = pthread_create(&tid, &attr, worker, this);
+	pthread_sigmask(SIG_SETMASK, &old, 0);
+	pthread_attr_destroy(&attr);
+	
+	if (e) {
+		errno = e;
+		return false;
+	}
+	running = true;
+	return true;
+}
+
+void kepco_async::stop() {
+	if (!running) return;
+	post(OP_QUIT);
+	pthread_join(tid, 0);
+	running = false;
+}
+
+void kepco_async::post(op_t o) {
+	op = o;
+	sem_post(&go);
+}
+
+void *kepco_async::worker(void *self) {
+	kepco_async &a = *(kepco_async*)self;
+	for (;;) {
+		while (sem_wait(&a.go) && errno == EINTR);
+		switch (a.op) {
+			case OP_READ: {
+				double v, i;
+				a.failed = a.psu.getVoltageAndCurrent(v, i);
+				if (!a.failed) {
+					a.Vm = v;
+					a.Im = i;
+				}
+				break;
+			}
+			case OP_SET_VOLTAGE:
+				a.failed = a.psu.setVoltage(a.Vset);
+				break;
+			case OP_BATCH:
+				a.failed = a.batch->run(a.psu);
+				break;
+			case OP_QUIT:
+				return 0;
+			default:
+				break;
+		}
+		sem_post(&a.done);
+	}
+}
+
+void kepco_async::beginRead() {
+	post(OP_READ);
+}
+
+bool kepco_async::endRead(double &v, double &i) {
+	while (sem_wait(&done) && errno == EINTR);
+	if (failed) return true;
+	v = Vm;
+	i = Im;
+	return false;
+}
+
+void kepco_async::beginSetVoltage(double v) {
+	Vset = v;
+	post(OP_SET_VOLTAGE);
+}
+
+bool kepco_async::endSetVoltage() {
+	while (sem_wait(&done) && errno == EINTR);
+	return failed;
+}
+
+void kepco_async::beginBatch(kepco_batch &b) {
+	batch = &b;
+	post(OP_BATCH);
+}
+
+bool kepco_async::endBatch() {
+	while (sem_wait(&done) && errno == EINTR);
+	return failed;
+}
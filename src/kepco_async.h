@@ -0,0 +1,77 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef KEPCO_ASYNC_H
+#define KEPCO_ASYNC_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include "kepco.h"
+#include "kepco_batch.h"
+
+// Runs the exchanges with one power supply on an I/O thread of its own, so
+// those with supplies on other ports can overlap. A begin*() call hands an
+// exchange to the thread and returns at once, the matching end*() call waits
+// for it and returns its result. One exchange at a time, and the supply must
+// not be used directly while the thread runs.
+class kepco_async {
+	kepco_bop &psu;
+	pthread_t tid;
+	bool running;
+	sem_t go, done;
+	
+	enum op_t { OP_NONE, OP_READ, OP_SET_VOLTAGE, OP_BATCH, OP_QUIT };
+	op_t op;
+	double Vset;   // In for OP_SET_VOLTAGE
+	double Vm, Im; // Out for OP_READ, when it succeeds
+	kepco_batch *batch;
+	bool failed;
+	
+	static void *worker(void *self);
+	void post(op_t o);
+	
+	// Non-copyable
+	kepco_async(const kepco_async &);
+	kepco_async &operator=(const kepco_async &);
+	
+	public:
+	kepco_async(kepco_bop &p);
+	~kepco_async();
+	
+	// Starts the I/O thread, under SCHED_FIFO at priority if above 0.
+	// Returns false, with errno set, on failure.
+	bool start(int priority=0);
+	void stop();
+	
+	// getVoltageAndCurrent(), split. end returns true on error, as it does,
+	// leaving v and i alone.
+	void beginRead();
+	bool endRead(double &v, double &i);
+	
+	// setVoltage(), split
+	void beginSetVoltage(double v);
+	bool endSetVoltage();
+	
+	// kepco_batch::run(), split. b must live until endBatch().
+	void beginBatch(kepco_batch &b);
+	bool endBatch();
+};
+
+#endif
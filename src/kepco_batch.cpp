@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "kepco_batch.h"
+#include <cmath>
+#include <cstring>
+
+void kepco_batch::clear() {
+	line.clear();
+	commands = 0;
+	queries = 0;
+	answered = 0;
+	failed = false;
+}
+
+int kepco_batch::append(const char *cmd) {
+	if (commands == KEPCO_BATCH_MAX) return -1;
+	if (commands) {
+		line<<';';
+		if (cmd[0] != ':' && cmd[0] != '*') line<<':';
+	}
+	line<<cmd;
+	return commands;
+}
+
+int kepco_batch::add(const char *cmd) {
+	int k = append(cmd);
+	if (k < 0) return -1;
+	reply_of[k] = std::strchr(cmd, '?') ? queries++ : -1;
+	return commands++;
+}
+
+int kepco_batch::add(const char *cmd, double v, int digits) {
+	int k = append(cmd);
+	if (k < 0) return -1;
+	line<<' ';
+	line.number(v, digits);
+	reply_of[k] = -1;
+	return commands++;
+}
+
+bool kepco_batch::run(kepco_bop &psu) {
+	answered = 0;
+	if (line.overflow()) {
+		std::strcpy(response, "ERROR (Batch too long)");
+		return failed = true;
+	}
+	const char *r = psu.exchange(line.c_str(), line.length());
+	std::strncpy(response, r, KEPCO_LINE_MAX);
+	response[KEPCO_LINE_MAX] = 0;
+	
+	// Replies are separated by ';', and there are none without queries
+	int n = 0;
+	if (queries) {
+		n = 1;
+		for (const char *c=response; *c; ++c) n += *c == ';';
+	}
+	if (n != queries || (!queries && *response)) return failed = true;
+	
+	char *c = response;
+	for (int k=0; k<queries; ++k) {
+		replies[k] = c;
+		c += std::strcspn(c, ";");
+		if (*c) *c++ = 0;
+	}
+	answered = queries;
+	return failed = false;
+}
+
+const char *kepco_batch::reply(int cmd) const {
+	if (cmd < 0 || cmd >= commands) return "";
+	int k = reply_of[cmd];
+	if (k < 0 || k >= answered) return "";
+	return replies[k];
+}
+
+double kepco_batch::value(int cmd) const {
+	double v;
+	return kepco_bop::parse_reals(reply(cmd), &v, 1) == 1 ? v : NAN;
+}
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef KEPCO_BATCH_H
+#define KEPCO_BATCH_H
+
+#include "kepco.h"
+
+// Most commands in a batch
+#define KEPCO_BATCH_MAX 16
+
+// Several SCPI commands sent to a power supply as one compound line, for a
+// single round trip. Commands are made absolute (":meas:volt?", not
+// "meas:volt?") so none depends on the path left by the one before it, and
+// their replies are matched back to the queries in order. Nothing is
+// allocated: the line is built in place, and the response is split in place.
+//
+//   kepco_batch b;
+//   int set = b.add("volt", Vr, psu.precision);
+//   int v   = b.add("meas:volt?");
+//   int i   = b.add("meas:curr?");
+//   if (!b.run(psu)) V = b.value(v), I = b.value(i);
+//
+// sends "volt 12.000;:meas:volt?;:meas:curr?" and splits "12.001;3.456".
+class kepco_batch {
+	scpi_line line;
+	int commands;
+	int reply_of[KEPCO_BATCH_MAX];          // Per command, index in replies, or -1
+	const char *replies[KEPCO_BATCH_MAX];   // Per query, into response
+	int queries;
+	int answered;                           // Replies in hand, after run()
+	char response[KEPCO_LINE_MAX+1];
+	bool failed;
+	
+	int append(const char *cmd);
+	
+	public:
+	kepco_batch() : commands(0), queries(0), answered(0), failed(false) { response[0] = 0; }
+	
+	void clear();
+	bool empty() const { return commands == 0; }
+	
+	// Appends a command, returns its index, or -1 if it does not fit.
+	// Queries are those with a '?'. The second form appends "cmd v", v with
+	// digits after the point.
+	int add(const char *cmd);
+	int add(const char *cmd, double v, int digits=3);
+	
+	// Sends the line and splits the response. Returns true on error, as
+	// kepco_bop does, with the response in lasterror().
+	bool run(kepco_bop &psu);
+	
+	const char *getLine() const { return line.c_str(); }
+	const char *reply(int cmd) const;  // Empty for commands that are not queries
+	double value(int cmd) const;       // NAN unless the reply is a number
+	const char *lasterror() const { return failed ? response : ""; }
+};
+
+#endif
@@ -0,0 +1,141 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "loop_telemetry.h"
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <time.h>
+
+using namespace std;
+
+static const char *stage_names[TICK_STAGES] = {
+	"PSU1 read",
+	"PSU2 read",
+	"Sensor read",
+	"Tracking",
+	"PSU writes",
+	"Logging"
+};
+
+int64_t telemetry_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return int64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+// Values below SUB have a bucket each, then SUB buckets per power of two.
+int latency_histogram::bucket(int64_t v) {
+	if (v < SUB) return v < 0 ? 0 : v;
+	int e = 63 - __builtin_clzll(v); // floor(log2(v)), 4 or more
+	int b = SUB + (e-4)*SUB + int((v >> (e-4)) & (SUB-1));
+	return b < BUCKETS ? b : BUCKETS-1;
+}
+
+int64_t latency_histogram::value(int b) {
+	if (b < SUB) return b;
+	int e = (b - SUB)/SUB + 4;
+	int64_t lo = (int64_t(SUB + (b - SUB)%SUB)) << (e-4);
+	return lo + (int64_t(1) << (e-4))/2;
+}
+
+void latency_histogram::clear() {
+	memset(count, 0, sizeof(count));
+	n = 0;
+	vmax = 0;
+}
+
+void latency_histogram::add(int64_t v) {
+	++count[bucket(v)];
+	++n;
+	if (v > vmax) vmax = v;
+}
+
+int64_t latency_histogram::percentile(double p) const {
+	if (!n) return 0;
+	long k = long(p/100*n + 0.5);
+	if (k < 1) k = 1;
+	long sum = 0;
+	for (int b=0; b<BUCKETS; ++b) {
+		sum += count[b];
+		if (sum >= k) return value(b) < vmax ? value(b) : vmax;
+	}
+	return vmax;
+}
+
+loop_telemetry::loop_telemetry() : dropped(0), start(0), last(0), prev_start(0), overruns(0), period(0) {
+	memset(&cur, 0, sizeof(cur));
+}
+
+void loop_telemetry::begin() {
+	start = last = telemetry_now();
+	memset(&cur, 0, sizeof(cur));
+	cur.interval = prev_start ? start - prev_start : 0;
+	prev_start = start;
+}
+
+void loop_telemetry::lap(tick_stage s) {
+	int64_t now = telemetry_now();
+	cur.stage[s] += now - last;
+	last = now;
+}
+
+void loop_telemetry::end() {
+	cur.total = telemetry_now() - start;
+	if (!ring.push(cur)) ++dropped;
+}
+
+void loop_telemetry::collect() {
+	tick_record r;
+	while (ring.pop(r)) {
+		for (int s=0; s<TICK_STAGES; ++s) stage[s].add(r.stage[s]);
+		total.add(r.total);
+		if (period && r.total > period) ++overruns;
+		if (!r.interval) continue;
+		interval.add(r.interval);
+		jitter.add(llabs(r.interval - period));
+	}
+}
+
+static void print(ostream &out, const char *name, const latency_histogram &h) {
+	out<<"  "<<setiosflags(ios::left)<<setw(14)<<name<<resetiosflags(ios::left);
+	out<<setw(10)<<1e-6*h.percentile(50);
+	out<<setw(10)<<1e-6*h.percentile(99);
+	out<<setw(10)<<1e-6*h.max()<<endl;
+}
+
+void loop_telemetry::report(ostream &out) {
+	collect();
+	ios::fmtflags f = out.flags();
+	streamsize p = out.precision();
+	char c = out.fill(' '); // The progress bar leaves '0'
+	out<<fixed<<setprecision(3);
+	out<<"Control loop timing, "<<total.samples()<<" ticks";
+	if (dropped) out<<" ("<<dropped<<" not recorded, ring full)";
+	out<<", "<<overruns<<" longer than the sample period:"<<endl;
+	out<<"  stage          p50 (ms)  p99 (ms)  max (ms)"<<endl;
+	for (int s=0; s<TICK_STAGES; ++s) print(out, stage_names[s], stage[s]);
+	print(out, "Whole tick", total);
+	print(out, "Interval", interval);
+	print(out, "Jitter", jitter);
+	out.flags(f);
+	out.precision(p);
+	out.fill(c);
+}
@@ -0,0 +1,101 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef LOOP_TELEMETRY_H
+#define LOOP_TELEMETRY_H
+
+#include <atomic>
+#include <iostream>
+#include <stdint.h>
+#include "spsc_ring.h"
+
+// Stages of a hardware loop tick
+enum tick_stage {
+	TICK_PSU1_READ,
+	TICK_PSU2_READ,
+	TICK_SENSOR_READ,
+	TICK_TRACKING,
+	TICK_PSU_WRITE,
+	TICK_LOGGING,
+	TICK_STAGES
+};
+
+// Timing of one tick, ns
+struct tick_record {
+	int64_t interval; // Since the start of the previous tick, 0 on the first
+	int64_t total;    // Whole tick
+	int64_t stage[TICK_STAGES];
+};
+
+// Log-linear histogram of durations in ns, 16 buckets per power of two, so
+// percentiles come within 1/32 of the true value.
+class latency_histogram {
+	enum { SUB = 16, BUCKETS = SUB + 59*SUB };
+	long count[BUCKETS];
+	long n;
+	int64_t vmax;
+	static int bucket(int64_t v);
+	static int64_t value(int b); // Middle of bucket b
+	
+	public:
+	latency_histogram() { clear(); }
+	void clear();
+	void add(int64_t v);
+	long samples() const { return n; }
+	int64_t max() const { return vmax; }
+	int64_t percentile(double p) const; // p in 0..100
+};
+
+// Per stage timing of the hardware loop. The control thread times each tick
+// with begin(), lap() and end(), and pushes the record into a lock-free ring,
+// never blocking nor allocating. Another thread drains the ring into
+// histograms with collect() and prints them with report(); records that find
+// the ring full are dropped, and counted.
+class loop_telemetry {
+	spsc_ring<tick_record, 4096> ring;
+	std::atomic<long> dropped;
+	
+	// Control thread
+	tick_record cur;
+	int64_t start, last, prev_start;
+	
+	// Collecting thread
+	latency_histogram stage[TICK_STAGES], total, interval, jitter;
+	long overruns;
+	
+	public:
+	int64_t period; // Sample period, ns
+	
+	loop_telemetry();
+	
+	// Control thread
+	void begin();           // Tick starts
+	void lap(tick_stage s); // Stage s ends, and took the time since the last lap
+	void end();             // Tick ends
+	
+	// One other thread
+	void collect();
+	void report(std::ostream &out); // collect()s first
+};
+
+// CLOCK_MONOTONIC, ns
+extern int64_t telemetry_now();
+
+#endif
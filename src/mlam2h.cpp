@@ -0,0 +1,277 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/***************************************************************************
+ *   MLAM map export: builds the tracker's uniform V(I,T) map, as mppt.cpp *
+ *   does, and writes it with the tracker constants as a self-contained C  *
+ *   header, in double, float or Q16.16 fixed point. Tables and constants  *
+ *   are constexpr (C++11 or C23), and a lookup function is included.      *
+ *                                                                         *
+ *   Temperatures are in Celsius.                                          *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include "arg_tool.h"
+#include "mppt_mlam.h"
+#include "fixedpoint.h"
+#include "pvgen_models.h"
+#include "pvgen_nominal_model.h"
+
+using namespace std;
+
+int iHelp, iGenerator, iReal, iNI, iNT, iType, iPrefix, iOutFile;
+arg_t args[] = {
+	{"-h",                &iHelp,      ARG_FLAG},
+	{"--help",            &iHelp,      ARG_FLAG},
+	{"--generator-model", &iGenerator, ARG_DEFAULT},
+	{"--real",            &iReal,      ARG_FLAG},
+	{"-nI",               &iNI,        ARG_DEFAULT},
+	{"-nT",               &iNT,        ARG_DEFAULT},
+	{"--type",            &iType,      ARG_DEFAULT},
+	{"--prefix",          &iPrefix,    ARG_DEFAULT},
+	{"-o",                &iOutFile,   ARG_DEFAULT},
+	{0,0,0}
+};
+
+// Map area, same as mppt.cpp, in multiples of Iphr and in Celsius.
+static const double mapI = 1.5;
+static const double mapT0 = 25, mapT1 = 100;
+// IncCond step of the mlam+ic tracker.
+static const double dVr = 0.01;
+
+enum type_t { DOUBLE, FLOAT, Q16 };
+static type_t type = FLOAT;
+
+// A literal of the exported type. Q16.16 values are raw integers.
+static string literal(double v) {
+	char s[40];
+	if (type == Q16) {
+		snprintf(s, sizeof(s), "%d", q16_16(v).raw());
+		return s;
+	}
+	snprintf(s, sizeof(s), type == FLOAT ? "%.9g" : "%.17g", v);
+	string r = s;
+	if (r.find_first_of(".en") == string::npos) r += ".0";
+	if (type == FLOAT) r += "f";
+	return r;
+}
+
+int main(int argc, const char *argv[]) {
+	if (arg_eval(argc, argv, args)) {
+		cerr<<"Error: Command line parsing failed."<<endl;
+		return 1;
+	}
+	if (iHelp) {
+		cout<<"Usage: mlam2h [--generator-model NAME] [--real] [-nI N] [-nT N]"<<endl;
+		cout<<"              [--type double|float|q16] [--prefix NAME] [-o FILE]"<<endl;
+		cout<<"Writes the MLAM map of the mppt tracker, and its constants, as a C"<<endl;
+		cout<<"header for embedded targets. Defaults: 128x4 nodes, float, prefix"<<endl;
+		cout<<"mlam, standard output."<<endl;
+		return 0;
+	}
+	
+	const char *typestr = iType ? argv[iType] : "float";
+	if      (strcmp(typestr, "double") == 0) type = DOUBLE;
+	else if (strcmp(typestr, "float")  == 0) type = FLOAT;
+	else if (strcmp(typestr, "q16")    == 0) type = Q16;
+	else {
+		cerr<<"Error: Unknown type \""<<typestr<<"\"."<<endl;
+		return 1;
+	}
+	int nI = iNI ? atoi(argv[iNI]) : 128;
+	int nT = iNT ? atoi(argv[iNT]) : 4;
+	if (nI < 2 || nT < 2) {
+		cerr<<"Error: Maps need at least 2x2 nodes."<<endl;
+		return 1;
+	}
+	string prefix = iPrefix ? argv[iPrefix] : "mlam";
+	string upper;
+	for (size_t i=0; i<prefix.size(); ++i) upper += toupper(prefix[i]);
+	string guard = upper + "_MAP_H";
+	string cx = upper + "_CONSTEXPR";
+	
+	// Tracker model, as set up by mppt.cpp
+	const pvGenerator::parameters_t *genparam = &generators[GEN_KC130TM];
+	if (iGenerator) {
+		genparam = generator_by_name(argv[iGenerator]);
+		if (!genparam) {
+			cerr<<"Error: Unknown generator model \""<<argv[iGenerator]<<"\"."<<endl;
+			return 1;
+		}
+	}
+	pvGenerator::model_parameters_t m = pvgen_nominal_model(genparam->nameplate);
+	m.Rs += 0.16;
+	if (iReal) m = genparam->model;
+	
+	mppt_mlam mlam;
+	mlam.Iphr = m.Iph * 1000/m.G;
+	mlam.mr   = m.m;
+	mlam.Ior  = m.I0;
+	mlam.Rs   = m.Rs;
+	mlam.Rp   = m.Rp;
+	mlam.Tr   = m.T - 273.16;
+	mlam.Ns   = m.Ns;
+	mlam.setMap(0, mlam.Iphr*mapI, nI, mapT0, mapT1, nT);
+	mppt_mlam::map_ptr map = mlam.getMap();
+	if (!map) {
+		cerr<<"Error: Failed to build the map."<<endl;
+		return 1;
+	}
+	
+	ofstream file;
+	if (iOutFile) {
+		file.open(argv[iOutFile], ios::out|ios::trunc);
+		if (!file) {
+			cerr<<"Error: Failed to create output file \""<<argv[iOutFile]<<"\"."<<endl;
+			return 1;
+		}
+	}
+	ostream &out = iOutFile ? file : cout;
+	
+	const char *ctype = type == DOUBLE ? "double" : type == FLOAT ? "float" : "int32_t";
+	const char *p = prefix.c_str();
+	double rdI = 1/(map->nodeX(1) - map->nodeX(0));
+	double rdT = 1/(map->nodeY(1) - map->nodeY(0));
+	char line[256];
+	
+	out<<"/* MLAM map for "<<genparam->name<<", "<<(iReal ? "fitted model" : "nameplate model, Rs+0.16 Ohm")<<"."<<endl;
+	out<<" * Generated by mlam2h, do not edit."<<endl;
+	out<<" *"<<endl;
+	out<<" * V(I,T) is the bilinear interpolation of "<<p<<"_V[iT][iI], with nodes at"<<endl;
+	out<<" *   I = "<<p<<"_I0 + iI/"<<p<<"_rdI, in A"<<endl;
+	out<<" *   T = "<<p<<"_T0 + iT/"<<p<<"_rdT, in Celsius"<<endl;
+	out<<" * and clamped to the edge cells outside them. The mlam+ic tracker adds"<<endl;
+	out<<" * an IncCond offset, in steps of "<<p<<"_dVr, to V(I,T)."<<endl;
+	if (type == Q16) {
+		out<<" *"<<endl;
+		out<<" * Values are Q16.16 fixed point, raw int32_t: x = raw/65536. Arithmetic"<<endl;
+		out<<" * saturates instead of wrapping around, as q16_16 (fixedpoint.h) does."<<endl;
+	}
+	out<<" */"<<endl;
+	out<<"#ifndef "<<guard<<endl;
+	out<<"#define "<<guard<<endl;
+	out<<endl;
+	out<<"#include <stdint.h>"<<endl;
+	out<<endl;
+	out<<"/* constexpr in C++ and C23, plain const in older C */"<<endl;
+	out<<"#if defined(__cplusplus) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 202311L)"<<endl;
+	out<<"#define "<<cx<<" constexpr"<<endl;
+	out<<"#else"<<endl;
+	out<<"#define "<<cx<<" const"<<endl;
+	out<<"#endif"<<endl;
+	out<<endl;
+	out<<"typedef "<<ctype<<" "<<p<<"_real;"<<endl;
+	out<<endl;
+	out<<"/* Tracker constants */"<<endl;
+	out<<"static "<<cx<<" int "<<p<<"_nI = "<<nI<<";"<<endl;
+	out<<"static "<<cx<<" int "<<p<<"_nT = "<<nT<<";"<<endl;
+	out<<"static "<<cx<<" "<<p<<"_real "<<p<<"_I0  = "<<literal(map->nodeX(0))<<";"<<endl;
+	out<<"static "<<cx<<" "<<p<<"_real "<<p<<"_rdI = "<<literal(rdI)<<";"<<endl;
+	out<<"static "<<cx<<" "<<p<<"_real "<<p<<"_T0  = "<<literal(map->nodeY(0))<<";"<<endl;
+	out<<"static "<<cx<<" "<<p<<"_real "<<p<<"_rdT = "<<literal(rdT)<<";"<<endl;
+	out<<"static "<<cx<<" "<<p<<"_real "<<p<<"_dVr = "<<literal(dVr)<<";"<<endl;
+	out<<endl;
+	out<<"/* Model the map was built from, for reference */"<<endl;
+	snprintf(line, sizeof(line), "static %s double %s_Iphr = %.17g; /* A */", cx.c_str(), p, mlam.Iphr); out<<line<<endl;
+	snprintf(line, sizeof(line), "static %s double %s_mr   = %.17g;", cx.c_str(), p, mlam.mr);           out<<line<<endl;
+	snprintf(line, sizeof(line), "static %s double %s_Ior  = %.17g; /* A */", cx.c_str(), p, mlam.Ior);  out<<line<<endl;
+	snprintf(line, sizeof(line), "static %s double %s_Rs   = %.17g; /* Ohm */", cx.c_str(), p, mlam.Rs); out<<line<<endl;
+	snprintf(line, sizeof(line), "static %s double %s_Rp   = %.17g; /* Ohm */", cx.c_str(), p, mlam.Rp); out<<line<<endl;
+	snprintf(line, sizeof(line), "static %s double %s_Tr   = %.17g; /* C */", cx.c_str(), p, mlam.Tr);   out<<line<<endl;
+	snprintf(line, sizeof(line), "static %s int    %s_Ns   = %d;", cx.c_str(), p, mlam.Ns);              out<<line<<endl;
+	out<<endl;
+	out<<"static "<<cx<<" "<<p<<"_real "<<p<<"_V["<<nT<<"]["<<nI<<"] = {"<<endl;
+	for (int iT=0; iT<nT; ++iT) {
+		out<<"\t{ /* T = "<<map->nodeY(iT)<<" C */";
+		for (int iI=0; iI<nI; ++iI) {
+			if (iI%8 == 0) out<<endl<<"\t\t";
+			out<<literal(map->node(iI, iT))<<(iI < nI-1 ? ", " : "");
+		}
+		out<<endl<<"\t}"<<(iT < nT-1 ? "," : "")<<endl;
+	}
+	out<<"};"<<endl;
+	out<<endl;
+	
+	// Lookup, same arithmetic as bilinear_table, saturating in Q16.16 as
+	// qfix does.
+	if (type == Q16) {
+		out<<"/* Saturating Q16.16 arithmetic, as q16_16 */"<<endl;
+		out<<"static inline int32_t "<<p<<"_sat(int64_t x) {"<<endl;
+		out<<"\treturn x > INT32_MAX ? INT32_MAX : x < INT32_MIN ? INT32_MIN : (int32_t)x;"<<endl;
+		out<<"}"<<endl;
+		out<<"static inline int32_t "<<p<<"_add(int32_t a, int32_t b) { return "<<p<<"_sat((int64_t)a + b); }"<<endl;
+		out<<"static inline int32_t "<<p<<"_sub(int32_t a, int32_t b) { return "<<p<<"_sat((int64_t)a - b); }"<<endl;
+		out<<"static inline int32_t "<<p<<"_mul(int32_t a, int32_t b) { return "<<p<<"_sat(((int64_t)a * b) >> 16); }"<<endl;
+		out<<endl;
+	}
+	out<<"static inline "<<p<<"_real "<<p<<"_lookup("<<p<<"_real I, "<<p<<"_real T) {"<<endl;
+	if (type == Q16) {
+		out<<"\tint32_t fx = "<<p<<"_mul("<<p<<"_sub(I, "<<p<<"_I0), "<<p<<"_rdI);"<<endl;
+		out<<"\tint32_t fy = "<<p<<"_mul("<<p<<"_sub(T, "<<p<<"_T0), "<<p<<"_rdT);"<<endl;
+		out<<"\tint ix = fx >= 0 ? fx >> 16 : (int)-(-(int64_t)fx >> 16);"<<endl;
+		out<<"\tint iy = fy >= 0 ? fy >> 16 : (int)-(-(int64_t)fy >> 16);"<<endl;
+	} else {
+		out<<"\t"<<p<<"_real fx = (I - "<<p<<"_I0) * "<<p<<"_rdI;"<<endl;
+		out<<"\t"<<p<<"_real fy = (T - "<<p<<"_T0) * "<<p<<"_rdT;"<<endl;
+		out<<"\tint ix = (int)fx;"<<endl;
+		out<<"\tint iy = (int)fy;"<<endl;
+	}
+	out<<"\tif (ix < 0) ix = 0;"<<endl;
+	out<<"\tif (ix > "<<p<<"_nI-2) ix = "<<p<<"_nI-2;"<<endl;
+	out<<"\tif (iy < 0) iy = 0;"<<endl;
+	out<<"\tif (iy > "<<p<<"_nT-2) iy = "<<p<<"_nT-2;"<<endl;
+	if (type == Q16) {
+		out<<"\tfx = "<<p<<"_sub(fx, (int32_t)ix << 16);"<<endl;
+		out<<"\tfy = "<<p<<"_sub(fy, (int32_t)iy << 16);"<<endl;
+	} else {
+		out<<"\tfx -= ix;"<<endl;
+		out<<"\tfy -= iy;"<<endl;
+	}
+	out<<"\tconst "<<p<<"_real *c0 = &"<<p<<"_V[iy][ix];"<<endl;
+	out<<"\tconst "<<p<<"_real *c1 = &"<<p<<"_V[iy+1][ix];"<<endl;
+	if (type == Q16) {
+		out<<"\tint32_t z0 = "<<p<<"_add(c0[0], "<<p<<"_mul(fx, "<<p<<"_sub(c0[1], c0[0])));"<<endl;
+		out<<"\tint32_t z1 = "<<p<<"_add(c1[0], "<<p<<"_mul(fx, "<<p<<"_sub(c1[1], c1[0])));"<<endl;
+		out<<"\treturn "<<p<<"_add(z0, "<<p<<"_mul(fy, "<<p<<"_sub(z1, z0)));"<<endl;
+	} else {
+		out<<"\t"<<p<<"_real z0 = c0[0] + fx*(c0[1]-c0[0]);"<<endl;
+		out<<"\t"<<p<<"_real z1 = c1[0] + fx*(c1[1]-c1[0]);"<<endl;
+		out<<"\treturn z0 + fy*(z1-z0);"<<endl;
+	}
+	out<<"}"<<endl;
+	out<<endl;
+	out<<"#endif"<<endl;
+	
+	if (!out) {
+		cerr<<"Error: Failed writing the header."<<endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,223 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "mlam_adapt.h"
+#include <cmath>
+#include <algorithm>
+
+// Points further than this many standard deviations from the prediction are
+// dropped.
+#define OUTLIER_SIGMAS 4
+
+mlam_adapter::mlam_adapter(mppt_mlam &tracker) : trk(tracker), wn(0), since(0), npoints(0), nrejected(0),
+	running(false), job_ready(false), stop(false), published(false), nmaps(0), nrows(0)
+{
+	pthread_mutex_init(&lock, 0);
+	pthread_cond_init(&cond, 0);
+	
+	window  = 20;
+	steadyI = 0.01*trk.Iphr;
+	steadyV = 0.05;
+	minI    = 0.05*trk.Iphr;
+	noise   = 0.05;
+	forget  = 0.999;
+	tol     = 0.005;
+	every   = 10;
+	
+	est.Iphr = trk.Iphr;
+	est.Tr   = trk.Tr;
+	est.Ns   = trk.Ns;
+	th[0] = trk.mr;
+	th[1] = log(trk.Ior);
+	th[2] = trk.Rs;
+	th[3] = 1/trk.Rp;
+	setModel();
+	
+	// Prior, loose enough to absorb nameplate-grade parameters.
+	for (int i=0; i<4; ++i)
+		for (int j=0; j<4; ++j) P[i][j] = 0;
+	P[0][0] = pow(0.1*th[0], 2);
+	P[1][1] = 1;
+	P[2][2] = pow(std::max(th[2], 0.1), 2);
+	P[3][3] = pow(std::max(th[3], 1e-3), 2);
+}
+
+mlam_adapter::~mlam_adapter() {
+	if (running) {
+		pthread_mutex_lock(&lock);
+		stop = true;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&lock);
+		pthread_join(tid, 0);
+	}
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&lock);
+}
+
+void mlam_adapter::setModel() {
+	est.mr  = th[0];
+	est.Ior = exp(th[1]);
+	est.Rs  = th[2];
+	est.Rp  = 1/th[3];
+}
+
+bool mlam_adapter::start() {
+	if (running) return true;
+	current = trk.getMap();
+	if (!current || !*current || window < 1 || every < 1) return false;
+	wV.assign(window, 0);
+	wI.assign(window, 0);
+	running = pthread_create(&tid, 0, worker, this) == 0;
+	return running;
+}
+
+double mlam_adapter::operator () (double V, double I, double T) {
+	if (!running) return 0;
+	
+	// Swap in a new map, if one is ready and the worker is not holding the
+	// lock. The old map goes back to the worker to be released.
+	double shift = 0;
+	if (published.load(std::memory_order_acquire) && pthread_mutex_trylock(&lock) == 0) {
+		if (published) {
+			shift = -trk(I,T);
+			trk.swapMap(pending);
+			shift += trk(I,T);
+			published = false;
+			++nmaps;
+			pthread_cond_signal(&cond);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+	
+	// Steady window
+	if (!(I >= minI) || !std::isfinite(V)) {
+		wn = 0;
+		return shift;
+	}
+	wV[wn % window] = V;
+	wI[wn % window] = I;
+	if (++wn < window) return shift;
+	
+	double Vmin = wV[0], Vmax = wV[0], Vsum = 0;
+	double Imin = wI[0], Imax = wI[0], Isum = 0;
+	for (int i=0; i<window; ++i) {
+		Vmin = std::min(Vmin, wV[i]); Vmax = std::max(Vmax, wV[i]); Vsum += wV[i];
+		Imin = std::min(Imin, wI[i]); Imax = std::max(Imax, wI[i]); Isum += wI[i];
+	}
+	if (Vmax-Vmin > steadyV || Imax-Imin > steadyI) return shift;
+	wn = 0;
+	update(Vsum/window, Isum/window, T);
+	
+	// Hand the estimate to the worker. If busy, try again next point.
+	if (++since >= every && pthread_mutex_trylock(&lock) == 0) {
+		job = est;
+		job_ready = true;
+		since = 0;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&lock);
+	}
+	return shift;
+}
+
+// One recursive least squares step. The model predicts the MPP voltage Vm at
+// I as the root of F(V,I) = 0, so for a measured MPP at V
+//   Vm - V ~ -F(V)/F_V,   dVm/dth = -(dF/dth)/F_V,
+// with dF/dth taken by central differences.
+void mlam_adapter::update(double V, double I, double T) {
+	double FV, F = est.locus(V, I, T, &FV);
+	if (!std::isfinite(F) || !(FV > 0)) return;
+	double e = F/FV; // V - Vm
+	
+	double h[4];
+	for (int i=0; i<4; ++i) {
+		double d = 1e-4*std::max(fabs(th[i]), i == 1 ? 1.0 : 1e-3);
+		double t = th[i];
+		th[i] = t + d; setModel();
+		double Fp = est.locus(V, I, T);
+		th[i] = t - d; setModel();
+		double Fm = est.locus(V, I, T);
+		th[i] = t;
+		h[i] = -(Fp-Fm)/(2*d)/FV;
+	}
+	setModel();
+	
+	double Ph[4], S = noise*noise;
+	for (int i=0; i<4; ++i) {
+		Ph[i] = 0;
+		for (int j=0; j<4; ++j) Ph[i] += P[i][j]*h[j];
+		S += h[i]*Ph[i];
+	}
+	if (!std::isfinite(e) || !std::isfinite(S) || e*e > OUTLIER_SIGMAS*OUTLIER_SIGMAS*S) {
+		++nrejected;
+		return;
+	}
+	
+	// P is symmetric, so h'P = (Ph)'.
+	for (int i=0; i<4; ++i) th[i] += Ph[i]/S*e;
+	for (int i=0; i<4; ++i)
+		for (int j=0; j<4; ++j) P[i][j] = (P[i][j] - Ph[i]*Ph[j]/S)/forget;
+	
+	th[0] = std::max(th[0], 1e-3);
+	th[2] = std::max(th[2], 0.0);
+	th[3] = std::max(th[3], 0.0);
+	setModel();
+	++npoints;
+}
+
+void *mlam_adapter::worker(void *self) {
+	mlam_adapter *a = (mlam_adapter *)self;
+	pthread_mutex_lock(&a->lock);
+	for (;;) {
+		while (!a->stop && !a->job_ready && (a->published || !a->pending))
+			pthread_cond_wait(&a->cond, &a->lock);
+		if (a->stop) break;
+		
+		// Maps are freed outside the lock.
+		mppt_mlam::map_ptr old;
+		if (!a->published) old.swap(a->pending);
+		if (!a->job_ready) {
+			pthread_mutex_unlock(&a->lock);
+			old.reset();
+			pthread_mutex_lock(&a->lock);
+			continue;
+		}
+		mppt_mlam model = a->job;
+		a->job_ready = false;
+		pthread_mutex_unlock(&a->lock);
+		old.reset();
+		
+		int rows;
+		mppt_mlam::map_ptr m = model.refreshMap(a->current, a->tol, &rows);
+		
+		pthread_mutex_lock(&a->lock);
+		if (m != a->current) {
+			// Replaces a map that never got swapped in, if any.
+			old.swap(a->pending);
+			a->pending = m;
+			a->current = m;
+			a->nrows += rows;
+			a->published.store(true, std::memory_order_release);
+			pthread_mutex_unlock(&a->lock);
+			old.reset();
+			pthread_mutex_lock(&a->lock);
+		}
+	}
+	pthread_mutex_unlock(&a->lock);
+	return 0;
+}
@@ -0,0 +1,107 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef MLAM_ADAPT_H
+#define MLAM_ADAPT_H
+
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include "mppt_mlam.h"
+
+// Online model adaptation for an MLAM tracker with a uniform map.
+//
+// Call it on every control step with the measured V, I and T. Once V and I
+// have held steady for a window of steps, the heuristic part of the tracker
+// has settled on the true MPP, and the window average is taken as a point of
+// the MPP locus. Those points drive a recursive least squares estimate of
+// (mr, ln Ior, Rs, 1/Rp), linearized on the locus equation.
+//
+// Every few points the estimate goes to a background thread, which rebuilds
+// the map rows it moved by more than tol on a private copy of the map. The
+// new map is swapped into the tracker on a later step, and the old one is
+// released by the background thread, so the control step never builds or
+// frees a map.
+//
+// The tracker must have a heuristic part, such as mppt_mlamhf, for V to
+// settle on the true MPP instead of on the map itself.
+class mlam_adapter {
+	mppt_mlam &trk;
+	mppt_mlam est;     // Current estimate, no map
+	double th[4];      // mr, ln Ior, Rs, 1/Rp
+	double P[4][4];    // Covariance of th
+	
+	std::vector<double> wV, wI; // Window of recent samples
+	int wn;
+	int since;         // Points since the last refresh request
+	int npoints, nrejected;
+	
+	// Background thread. Under lock: job, job_ready, pending, stop.
+	pthread_t tid;
+	bool running;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool job_ready, stop;
+	mppt_mlam job;
+	mppt_mlam::map_ptr pending;   // New map, or the old one after a swap
+	std::atomic<bool> published;  // pending holds a new map
+	mppt_mlam::map_ptr current;   // Latest map built, worker only
+	std::atomic<int> nmaps, nrows;
+	
+	void setModel();
+	void update(double V, double I, double T);
+	static void *worker(void *self);
+	
+	// Non-copyable
+	mlam_adapter(const mlam_adapter &);
+	mlam_adapter &operator=(const mlam_adapter &);
+	
+	public:
+	int    window;  // Steps V and I must hold steady
+	double steadyI; // Largest current spread over the window, A
+	double steadyV; // Largest voltage spread over the window, V
+	double minI;    // Current below which samples are ignored, A
+	double noise;   // Voltage measurement noise, standard deviation, V
+	double forget;  // Forgetting factor, per point
+	double tol;     // Map rows off by more than this get rebuilt, V
+	int    every;   // Points between map refreshes
+	
+	// Starts from the tracker's current parameters. Settings above may be
+	// changed until start().
+	mlam_adapter(mppt_mlam &tracker);
+	~mlam_adapter();
+	
+	// Starts the background thread. Fails unless the tracker uses a uniform
+	// map.
+	bool start();
+	
+	// Control step, T in Celsius. Returns how much the map moved at (I,T) if a
+	// new one was swapped in, 0 otherwise, so a heuristic offset riding on top
+	// of the map can be compensated.
+	double operator () (double V, double I, double T);
+	
+	// Statistics
+	const mppt_mlam &estimate() const { return est; }
+	int points() const { return npoints; }     // Locus points used
+	int rejected() const { return nrejected; } // Points dropped as outliers
+	int maps() const { return nmaps; }         // Maps swapped in
+	int rows() const { return nrows; }         // Rows rebuilt
+};
+
+#endif
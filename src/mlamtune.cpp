@@ -0,0 +1,332 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/***************************************************************************
+ *   MLAM map tuning: builds the tracker's V(I,T) map with several schemes *
+ *   and resolutions, and compares them at the MPP currents of a (G,T)     *
+ *   domain against the exact value. Prints memory, error and lookup cost  *
+ *   of each, and which ones are on the Pareto front.                      *
+ *                                                                         *
+ *   Temperatures are in Celsius, except for pvGenerator (KELVIN).         *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "arg_tool.h"
+#include "rdtsc.h"
+#include "mppt_mlam.h"
+#include "pvgen_sc.h"
+#include "pvgen_mpp_I.h"
+#include "pvgen_models.h"
+#include "pvgen_nominal_model.h"
+
+using namespace std;
+
+int iHelp, iGenerator, iReal, iThreads, iG0, iG1, iT0, iT1;
+arg_t args[] = {
+	{"-h",                &iHelp,      ARG_FLAG},
+	{"--help",            &iHelp,      ARG_FLAG},
+	{"--generator-model", &iGenerator, ARG_DEFAULT},
+	{"--real",            &iReal,      ARG_FLAG},
+	{"-j",                &iThreads,   ARG_DEFAULT},
+	{"--G0",              &iG0,        ARG_DEFAULT},
+	{"--G1",              &iG1,        ARG_DEFAULT},
+	{"--T0",              &iT0,        ARG_DEFAULT},
+	{"--T1",              &iT1,        ARG_DEFAULT},
+	{0,0,0}
+};
+
+// Map area, same as mppt.cpp, in multiples of Iphr and in Celsius.
+static const double mapI = 1.5;
+static const double mapT0 = 25, mapT1 = 100;
+
+enum scheme_t { UNIFORM, LAZY, ADAPTIVE, POLY };
+static const char *scheme_name[] = { "uniform", "lazy", "adaptive", "poly" };
+
+struct config {
+	scheme_t scheme;
+	int nI, nT;    // UNIFORM and LAZY: nodes over the map area, POLY: degrees
+	double tol;    // ADAPTIVE
+	
+	mppt_mlam mlam;
+	bool   ok;
+	size_t mem;
+	double buildms, maxerr, rmserr, cycles;
+	bool   pareto;
+};
+
+static mppt_mlam model;
+static vector<double> sI, sT, sV; // MPP current, temperature and exact V
+static vector<config> cfg;
+static std::atomic<int> next_cfg;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+// Builds the map of c and measures its error over the samples.
+static void evaluate(config &c) {
+	c.mlam = model;
+	double Iphr = model.Iphr;
+	double t0 = now();
+	switch (c.scheme) {
+		case UNIFORM:
+			c.mlam.setMap(0, Iphr*mapI, c.nI, mapT0, mapT1, c.nT);
+			break;
+		case LAZY:
+			c.mlam.setLazyMap(
+				0,     Iphr*mapI/(c.nI-1), mapT0, (mapT1-mapT0)/(c.nT-1),
+				0,     Iphr*4,             -60,   150
+			);
+			break;
+		case ADAPTIVE:
+			c.mlam.setAdaptiveMap(0, Iphr*mapI, mapT0, mapT1, c.tol);
+			break;
+		case POLY:
+			c.mlam.setSurrogate(Iphr*0.05, Iphr*mapI, mapT0, mapT1, c.nI, c.nT);
+			break;
+	}
+	c.buildms = 1e3*(now() - t0);
+	c.ok = c.mlam;
+	if (!c.ok) return;
+	
+	double emax = 0, esum = 0;
+	for (size_t i=0; i<sI.size(); ++i) {
+		double e = fabs(c.mlam(sI[i], sT[i]) - sV[i]);
+		if (!(e <= emax)) emax = e; // NaN sticks
+		esum += e*e;
+	}
+	c.maxerr = emax;
+	c.rmserr = sqrt(esum/sI.size());
+	c.mem = c.mlam.memory(); // After lookups, lazy maps have grown by now
+}
+
+static void *worker(void *) {
+	for (int i; (i = next_cfg++) < int(cfg.size()); ) evaluate(cfg[i]);
+	return 0;
+}
+
+// Cycles per lookup, best of a few runs. Run on one thread, after the sweep,
+// so configurations do not disturb each other.
+static double lookup_cycles(const mppt_mlam &m) {
+	int n = sI.size();
+	int rounds = 1 + 400000/n;
+	volatile double sink = 0;
+	
+	double s = 0, best = HUGE_VAL;
+	for (int i=0; i<n; ++i) s += m(sI[i], sT[i]); // Warm up
+	for (int k=0; k<5; ++k) {
+		timestamp t0 = read_timestamp_counter();
+		for (int r=0; r<rounds; ++r)
+			for (int i=0; i<n; ++i) s += m(sI[i], sT[i]);
+		timestamp t1 = read_timestamp_counter();
+		best = min(best, double(t1-t0)/(double(rounds)*n));
+	}
+	sink = s;
+	(void)sink;
+	return best;
+}
+
+// a dominates b if it is no worse on every count, and better on one. Cycle
+// counts within 10% are taken as equal, or timing noise alone would keep
+// most configurations on the front.
+static bool dominates(const config &a, const config &b) {
+	bool faster = a.cycles*1.1 < b.cycles;
+	bool slower = b.cycles*1.1 < a.cycles;
+	if (a.mem > b.mem || a.maxerr > b.maxerr || slower) return false;
+	return a.mem < b.mem || a.maxerr < b.maxerr || faster;
+}
+
+static void print(const config &c) {
+	char par[32];
+	if      (c.scheme == ADAPTIVE) snprintf(par, sizeof(par), "tol=%gV", c.tol);
+	else if (c.scheme == POLY)     snprintf(par, sizeof(par), "deg=%d,%d", c.nI, c.nT);
+	else                           snprintf(par, sizeof(par), "%dx%d", c.nI, c.nT);
+	cout<<(c.pareto ? "* " : "  ");
+	cout<<setiosflags(ios::left)<<setw(9)<<scheme_name[c.scheme]<<setw(12)<<par<<resetiosflags(ios::left);
+	if (!c.ok) {
+		cout<<"  build failed"<<endl;
+		return;
+	}
+	cout<<fixed;
+	cout<<setw(9)<<c.mem;
+	cout<<setw(11)<<setprecision(3)<<1e3*c.maxerr;
+	cout<<setw(11)<<setprecision(3)<<1e3*c.rmserr;
+	cout<<setw(9)<<setprecision(1)<<c.cycles;
+	cout<<setw(10)<<setprecision(2)<<c.buildms;
+	cout<<endl;
+}
+
+int main(int argc, const char *argv[]) {
+	if (arg_eval(argc, argv, args)) {
+		cerr<<"Error: Command line parsing failed."<<endl;
+		return 1;
+	}
+	if (iHelp) {
+		cout<<"Usage: mlamtune [--generator-model NAME] [--real] [-j THREADS]"<<endl;
+		cout<<"                [--G0 W/m2] [--G1 W/m2] [--T0 C] [--T1 C]"<<endl;
+		cout<<"Sweeps MLAM map schemes and resolutions, and reports memory, worst"<<endl;
+		cout<<"and RMS voltage error at the MPP over the (G,T) domain, and CPU"<<endl;
+		cout<<"cycles per lookup. Lines marked * are on the Pareto front."<<endl;
+		return 0;
+	}
+	
+	cout<<"<< MLAM map tuning >>"<<endl;
+	
+	// Tracker model, as set up by mppt.cpp
+	const pvGenerator::parameters_t *genparam = &generators[GEN_KC130TM];
+	if (iGenerator) {
+		genparam = generator_by_name(argv[iGenerator]);
+		if (!genparam) {
+			cerr<<"Error: Unknown generator model \""<<argv[iGenerator]<<"\"."<<endl;
+			return 1;
+		}
+	}
+	pvGenerator::model_parameters_t m = pvgen_nominal_model(genparam->nameplate);
+	m.Rs += 0.16;
+	if (iReal) m = genparam->model;
+	
+	model.Iphr = m.Iph * 1000/m.G;
+	model.mr   = m.m;
+	model.Ior  = m.I0;
+	model.Rs   = m.Rs;
+	model.Rp   = m.Rp;
+	model.Tr   = m.T - 273.16;
+	model.Ns   = m.Ns;
+	
+	// Maps are to be built, not loaded from an old run
+	mppt_mlam::setCacheDir(0);
+	
+	// Samples: MPP current of a generator matching the tracker model, on
+	// a (G,T) grid.
+	double G0 = iG0 ? atof(argv[iG0]) : 100;
+	double G1 = iG1 ? atof(argv[iG1]) : 1000;
+	double T0 = iT0 ? atof(argv[iT0]) : mapT0;
+	double T1 = iT1 ? atof(argv[iT1]) : mapT1;
+	int nG = 91, nT = 76;
+	cout<<"Generator "<<genparam->name<<(iReal ? " (fitted model)" : " (nameplate model)")<<", ";
+	cout<<"G = "<<G0<<".."<<G1<<" W/m^2, T = "<<T0<<".."<<T1<<" C"<<endl;
+	cout<<"Sampling "<<nG*nT<<" operating points... "<<flush;
+	
+	pvGenerator_sc gen;
+	gen.setModel(m);
+	for (int iT=0; iT<nT; ++iT) {
+		double T = T0 + (T1-T0)*iT/(nT-1);
+		gen.setTemperature(T + 273.16);
+		for (int iG=0; iG<nG; ++iG) {
+			gen.setInsolation(G0 + (G1-G0)*iG/(nG-1));
+			double I = pvgen_mpp_I(gen, 0, gen.getSourceCurrent(), 1e-6);
+			sI.push_back(I);
+			sT.push_back(T);
+			sV.push_back(model.exact(I, T));
+		}
+	}
+	cout<<"Ok."<<endl;
+	
+	// Configurations
+	static const int uI[] = { 16, 32, 64, 128, 256, 512, 1024 };
+	static const int uT[] = { 2, 3, 4, 6, 8, 16 };
+	static const int lI[] = { 32, 128, 512 };
+	static const int lT[] = { 4, 8 };
+	static const double aTol[] = { 0.1, 0.03, 0.01, 0.003, 0.001 };
+	static const int pI[] = { 2, 3, 4, 5, 6 };
+	static const int pT[] = { 1, 2 };
+	for (size_t i=0; i<sizeof(uI)/sizeof(*uI); ++i) {
+		for (size_t j=0; j<sizeof(uT)/sizeof(*uT); ++j) {
+			config c = config();
+			c.scheme = UNIFORM; c.nI = uI[i]; c.nT = uT[j];
+			cfg.push_back(c);
+		}
+	}
+	for (size_t i=0; i<sizeof(lI)/sizeof(*lI); ++i) {
+		for (size_t j=0; j<sizeof(lT)/sizeof(*lT); ++j) {
+			config c = config();
+			c.scheme = LAZY; c.nI = lI[i]; c.nT = lT[j];
+			cfg.push_back(c);
+		}
+	}
+	for (size_t i=0; i<sizeof(aTol)/sizeof(*aTol); ++i) {
+		config c = config();
+		c.scheme = ADAPTIVE; c.tol = aTol[i];
+		cfg.push_back(c);
+	}
+	for (size_t i=0; i<sizeof(pI)/sizeof(*pI); ++i) {
+		for (size_t j=0; j<sizeof(pT)/sizeof(*pT); ++j) {
+			config c = config();
+			c.scheme = POLY; c.nI = pI[i]; c.nT = pT[j];
+			cfg.push_back(c);
+		}
+	}
+	
+	// Build and measure accuracy in parallel
+	int nthreads = iThreads ? atoi(argv[iThreads]) : sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1) nthreads = 1;
+	cout<<"Building "<<cfg.size()<<" maps on "<<nthreads<<" threads... "<<flush;
+	next_cfg = 0;
+	vector<pthread_t> tid(nthreads);
+	for (int i=0; i<nthreads; ++i) {
+		if (pthread_create(&tid[i], 0, worker, 0)) {
+			nthreads = i;
+			break;
+		}
+	}
+	if (nthreads == 0) worker(0);
+	for (int i=0; i<nthreads; ++i) pthread_join(tid[i], 0);
+	cout<<"Ok."<<endl;
+	
+	cout<<"Timing lookups... "<<flush;
+	for (size_t i=0; i<cfg.size(); ++i) if (cfg[i].ok) cfg[i].cycles = lookup_cycles(cfg[i].mlam);
+	cout<<"Ok."<<endl;
+	
+	for (size_t i=0; i<cfg.size(); ++i) {
+		cfg[i].pareto = cfg[i].ok;
+		for (size_t j=0; j<cfg.size() && cfg[i].pareto; ++j)
+			if (cfg[j].ok && dominates(cfg[j], cfg[i])) cfg[i].pareto = false;
+	}
+	
+	cout<<endl;
+	cout<<"  scheme   grid          memory  max [mV]  rms [mV]   cycles  build[ms]"<<endl;
+	for (size_t i=0; i<cfg.size(); ++i) print(cfg[i]);
+	
+	// Front, smallest first
+	vector<config*> front;
+	for (size_t i=0; i<cfg.size(); ++i) if (cfg[i].pareto) front.push_back(&cfg[i]);
+	sort(front.begin(), front.end(), [](const config *a, const config *b) {
+		return a->mem < b->mem || (a->mem == b->mem && a->maxerr > b->maxerr);
+	});
+	cout<<endl<<"Pareto front (memory, max error, cycles):"<<endl;
+	for (size_t i=0; i<front.size(); ++i) print(*front[i]);
+	
+	return 0;
+}
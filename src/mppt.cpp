@@ -35,16 +35,24 @@
 #include <sys/wait.h>
 #include <errno.h>
 #include <semaphore.h>
+#include <sched.h>
+#include <sys/resource.h>
 
 // My libraries
 #include "arg_tool.h"
 #include "straux.h"
 #include "kepco.h"
+#include "kepco_async.h"
+#include "kepco_batch.h"
 #include "matv4.h"
 #include "smalt.h"
 #include "load_dat.h"
 #include "progressbar.h"
+#include "rdtsc.h"
 #include "destroyer.h"
+#include "rt_loop.h"
+#include "loop_telemetry.h"
+#include "sample_logger.h"
 
 // PV generator related includes
 #include "pvgen.h"
@@ -56,9 +64,13 @@
 #include "mppt_inccond.h"
 #include "mppt_mlam.h"
 #include "mppt_mlamhf.h"
+#include "mlam_adapt.h"
 #include "mppt_temperature.h"
 #include "mppt_temperaturehf.h"
+#include "mppt_gscan.h"
 #include "pvgen_model_test.h"
+#include "synth_stimuli.h"
+#include "solver_stats.h"
 
 // Other local includes
 #include "pid_file_handler.h"
@@ -80,7 +92,10 @@ int iSensorTest, iSensorAddr, iSensorPort;
 int iHelp, iQuiet, iPID;
 //   Simulation modifiers
 int iStimuli, skip_boot, iTracker;
-int generator_model, iModelTest;
+int generator_model, iModelTest, iMapCache, iMlamMap, iAdapt;
+int iShadedCells, iBypassCells, iShadeLevel, iBench, iBenchDays;
+//   Hardware loop timing
+int iRtPrio, iCpu, iMlock, iOverrun, iConcurrentIo, iByteEcho, iBatchIo, iPsuDigits, iSerialLog, iLogFlush;
 
 arg_t args[] = {
 	{"-h",        &iHelp,          ARG_FLAG},
@@ -98,26 +113,53 @@ arg_t args[] = {
 	{"-o",        &iOutFile,       ARG_DEFAULT},
 	{"-q",        &iQuiet,         ARG_FLAG},
 	
+	{"--rt-prio",             &iRtPrio,         ARG_DEFAULT},
+	{"--cpu",                 &iCpu,            ARG_DEFAULT},
+	{"--mlock",               &iMlock,          ARG_FLAG},
+	{"--overrun",             &iOverrun,        ARG_DEFAULT},
+	{"--concurrent-io",       &iConcurrentIo,   ARG_FLAG},
+	{"--byte-echo",           &iByteEcho,       ARG_FLAG},
+	{"--batch-io",            &iBatchIo,        ARG_FLAG},
+	{"--psu-digits",          &iPsuDigits,      ARG_DEFAULT},
+	{"--serial-log",          &iSerialLog,      ARG_DEFAULT},
+	{"--log-flush",           &iLogFlush,       ARG_DEFAULT},
+	
 	{"--stimuli",             &iStimuli,        ARG_DEFAULT},
 	{"--skip-boot",           &skip_boot,       ARG_FLAG},
 	{"--tracker",             &iTracker,        ARG_DEFAULT},
 	{"--generator-model",     &generator_model, ARG_DEFAULT},
 	{"-mt",                   &iModelTest,      ARG_FLAG},
+	{"--map-cache",           &iMapCache,       ARG_DEFAULT},
+	{"--mlam-map",            &iMlamMap,        ARG_DEFAULT},
+	{"--adapt",               &iAdapt,          ARG_FLAG},
+	{"--shaded-cells",        &iShadedCells,    ARG_DEFAULT},
+	{"--bypass-cells",        &iBypassCells,    ARG_DEFAULT},
+	{"--shade-level",         &iShadeLevel,     ARG_DEFAULT},
+	{"--bench",               &iBench,          ARG_FLAG},
+	{"--bench-days",          &iBenchDays,      ARG_DEFAULT},
 	{0,0,0}
 };
 
 // Global parameters
 double dDuration, dSamplePeriod;
+serial_tap serial_log;                    // Used with --serial-log, outlives the supplies
 kepco_bop psu1, psu2;
+kepco_async psu1_io(psu1), psu2_io(psu2); // Used with --concurrent-io
+kepco_batch psu1_batch, psu2_batch;       // Used with --batch-io
 denis_sensors sensor;
 double startTime;
-ofstream outFile;
+ofstream outFile;                         // Simulation runs
+sample_logger logger;                     // Hardware loop, -o
 sem_t main_wait;
 
 // Available MPP Trackers
 mppt_inccond       track_ic;
 mppt_mlamhf        track_mlamhf;
 mppt_temperaturehf track_temperaturehf;
+mppt_gscan_periodic track_gscan_periodic;
+mppt_gscan_adaptive track_gscan_adaptive;
+mppt_gscan         *track_gscan = 0; // The one in use, if any
+mlam_adapter      *adapter = 0; // Refines the MLAM model, --adapt
 double tracker_truempp      (pvGenerator &gen, double V, double I, double T) {
 	return gen.V(pvgen_mpp_I(gen, 0, gen.getSourceCurrent(), 1e-4));
 }
@@ -125,14 +167,16 @@ double tracker_ic           (pvGenerator &gen, double V, double I, double T) { r
 double tracker_mlamhf       (pvGenerator &gen, double V, double I, double T) { return track_mlamhf       (V, I, T-273.16); }
 double tracker_mlamhf_notemp(pvGenerator &gen, double V, double I, double T) { return track_mlamhf       (V, I, 40      ); }
 double tracker_temperaturehf(pvGenerator &gen, double V, double I, double T) { return track_temperaturehf(V, I, T       ); }
+double tracker_gscan        (pvGenerator &gen, double V, double I, double T) { return (*track_gscan)       (V, I, gen.getInsolation()); }
 double tracker_mlamhf_temp  (pvGenerator &gen, double V, double I, double T) {
 	return track_mlamhf       (V, I, 40      ) + track_temperaturehf(V, I, T);
 }
 double (*tracker)(pvGenerator &gen, double V, double I, double T) = &tracker_mlamhf;
 
-// Handler for SIGALRM
-sem_t alarm_sem;
-void alarm_handler(int);
+// Hardware control loop, one tick per sample period
+rt_loop control;
+loop_telemetry telemetry;
+bool control_tick(void *);
 
 // Handler for SIGINT
 volatile bool interrupt_process=false;
@@ -140,6 +184,12 @@ void interrupt_handler(int) {
 	interrupt_process=true;
 }
 
+// Handler for SIGUSR1, prints the loop timing so far
+volatile sig_atomic_t report_requested=false;
+void report_handler(int) {
+	report_requested=true;
+}
+
 // Get time of day as a high-res(1ns) double.
 double getTime() {
 	struct timespec ts;
@@ -158,10 +208,24 @@ void remove_signal_handlers(void *) {
 	cout<<"Removing signal handlers... "<<flush;
 	signal(SIGINT,  SIG_IGN);
 	signal(SIGTERM, SIG_IGN);
-	signal(SIGALRM, SIG_IGN);
-	sem_destroy(&alarm_sem);
+	signal(SIGUSR1, SIG_IGN);
+	sem_destroy(&main_wait);
 	cout<<" Ok."<<endl;
 }
+void stop_control_loop(void *) {
+	control.stop();
+}
+void stop_psu_threads(void *) {
+	psu1_io.stop();
+	psu2_io.stop();
+}
+void close_logger(void *) {
+	logger.close();
+}
+void destroy_adapter(void *) {
+	delete adapter;
+	adapter = 0;
+}
 
 // Main
 int main(int argc, const char *argv[]) {
@@ -194,7 +258,7 @@ int main(int argc, const char *argv[]) {
 	
 	// Check which parameter set is required
 	bool bRequireSensors=false, bRequireTiming=false, bRequirePsu=false;
-	if (iStimuli || iModelTest) {
+	if (iStimuli || iModelTest || iBench) {
 		// simulation run, no hardware or timing required
 		if (iSensorTest)    cerr<<"Simulation run: Ignoring -st."<<endl;
 		if (iPsuTest)       cerr<<"Simulation run: Ignoring -pt."<<endl;
@@ -235,6 +299,35 @@ int main(int argc, const char *argv[]) {
 			cerr<<"Error: -t requires a positive floating point parameter."<<endl;
 			return 1;
 		}
+		
+		control.period = dSamplePeriod;
+		control.delay  = 1;
+		if (iRtPrio) {
+			control.priority = strIsInt(argv[iRtPrio]) ? atoi(argv[iRtPrio]) : -1;
+			if (control.priority < sched_get_priority_min(SCHED_FIFO) || control.priority > sched_get_priority_max(SCHED_FIFO)) {
+				cerr<<"Error: --rt-prio requires a SCHED_FIFO priority, "<<sched_get_priority_min(SCHED_FIFO)
+					<<" to "<<sched_get_priority_max(SCHED_FIFO)<<"."<<endl;
+				return 1;
+			}
+		}
+		if (iCpu) {
+			control.cpu = strIsInt(argv[iCpu]) ? atoi(argv[iCpu]) : -1;
+			if (control.cpu < 0 || control.cpu >= CPU_SETSIZE) {
+				cerr<<"Error: --cpu requires a CPU number."<<endl;
+				return 1;
+			}
+		}
+		if (iOverrun && !rt_overrun_policy_by_name(argv[iOverrun], control.overrun)) {
+			cerr<<"Error: --overrun requires skip, catchup or abort."<<endl;
+			return 1;
+		}
+		if (iLogFlush) {
+			logger.flushInterval = strIsInt(argv[iLogFlush]) ? atoi(argv[iLogFlush]) : -1;
+			if (logger.flushInterval < 0) {
+				cerr<<"Error: --log-flush requires an interval in ms, 0 or more."<<endl;
+				return 1;
+			}
+		}
 	}
 	
 	if (bRequirePsu && (!iPsu1 || !iPsu2)) {
@@ -250,6 +343,25 @@ int main(int argc, const char *argv[]) {
 	// Connect to the power supplies
 	if (bRequirePsu) {
 		cout<<"Connecting to the power supplies... "<<flush;
+		psu1.byte_echo = psu2.byte_echo = iByteEcho;
+		if (iPsuDigits) {
+			int n = strIsInt(argv[iPsuDigits]) ? atoi(argv[iPsuDigits]) : -1;
+			if (n < 0 || n > 6) {
+				cout<<"ERROR."<<endl;
+				cerr<<"Error: --psu-digits requires 0 to 6 digits."<<endl;
+				return 1;
+			}
+			psu1.precision = psu2.precision = n;
+		}
+		if (iSerialLog) {
+			if (!serial_log.open(argv[iSerialLog])) {
+				cout<<"ERROR."<<endl;
+				cerr<<"Error: Failed to create \""<<argv[iSerialLog]<<"\"."<<endl;
+				return 1;
+			}
+			psu1.setTap(&serial_log, 1);
+			psu2.setTap(&serial_log, 2);
+		}
 		psu1.open(argv[iPsu1], 9600);
 		psu2.open(argv[iPsu2], 9600);
 		if (!psu1 || !psu2) {
@@ -281,7 +393,13 @@ int main(int argc, const char *argv[]) {
 			cout<<"Emulate."<<endl;
 		} else {
 			if (iSensorPort) {
-				sensor.open(argv[iSensorAddr], htons(atoi(argv[iSensorPort])));
+				int port = strIsInt(argv[iSensorPort]) ? atoi(argv[iSensorPort]) : 0;
+				if (port <= 0 || port > 65535) {
+					cout<<"Error."<<endl;
+					cerr<<"Error: -sp requires a TCP port number."<<endl;
+					return 1;
+				}
+				sensor.open(argv[iSensorAddr], port);
 			} else {
 				sensor.open(argv[iSensorAddr]);
 			}
@@ -378,6 +496,16 @@ int main(int argc, const char *argv[]) {
 	
 	// Prepare MPP trackers
 	cout<<"Preparing MPPT trackers ("<<genparam->name<<")... "<<flush;
+	if (iMapCache) mppt_mlam::setCacheDir(argv[iMapCache]);
+	int bypass = genparam->nameplate.Ns/2; // Cells per bypass diode
+	if (iBypassCells) {
+		bypass = strIsInt(argv[iBypassCells]) ? atoi(argv[iBypassCells]) : -1;
+		if (bypass < 0) {
+			cout<<"Error."<<endl;
+			cerr<<"Error: --bypass-cells requires a non-negative integer parameter."<<endl;
+			return 1;
+		}
+	}
 	if (true) {
 		pvGenerator::model_parameters_t m = pvgen_nominal_model(genparam->nameplate);
 		m.Rs += 0.16;
@@ -388,9 +516,19 @@ int main(int argc, const char *argv[]) {
 		track_temperaturehf.kVT    = genparam->nameplate.kT_Voc;
 		track_temperaturehf.dVr = 0.01;
 
+		// Global trackers look for a peak per bypass group, spaced a little
+		// below the group MPP voltage to stay clear of the knee on hot days.
+		int groups = bypass ? (genparam->nameplate.Ns + bypass-1)/bypass : 1;
+		mppt_gscan *gs[] = { &track_gscan_periodic, &track_gscan_adaptive };
+		for (int i=0; i<2; ++i) {
+			gs[i]->npeaks = groups;
+			gs[i]->Vpeak  = genparam->nameplate.Vmp*0.8/groups;
+			gs[i]->Imax   = genparam->nameplate.Isc*1.2;
+		}
+		
 		tracker = tracker_mlamhf;
 		
-		const char *name = "MLAM";
+		const char *name = "mlam+ic";
 		if (iTracker) name = argv[iTracker];
 		
 		if        (stricmp(name, "truempp") == 0) {
@@ -432,6 +570,14 @@ int main(int argc, const char *argv[]) {
 		} else if (stricmp(name, "temp+ic") == 0) {
 			tracker = &tracker_temperaturehf;
 			
+		} else if (stricmp(name, "gscan-periodic") == 0) {
+			tracker = &tracker_gscan;
+			track_gscan = &track_gscan_periodic;
+			
+		} else if (stricmp(name, "gscan-adaptive") == 0) {
+			tracker = &tracker_gscan;
+			track_gscan = &track_gscan_adaptive;
+			
 		} else if (stricmp(name, "mlam+ic+temp") == 0) {
 			tracker = &tracker_mlamhf_temp;
 			track_temperaturehf.dVr    = 0;
@@ -457,137 +603,289 @@ int main(int argc, const char *argv[]) {
 		track_mlamhf.Tr   = m.T - 273.16;
 		track_mlamhf.Ns   = m.Ns;
 	
-		track_mlamhf.setMap(0, track_mlamhf.Iphr*1.5, 128, 25, 100, 4);
+		const char *mapmode = iMlamMap ? argv[iMlamMap] : "uniform";
+		if        (stricmp(mapmode, "uniform") == 0) {
+			track_mlamhf.setMap(0, track_mlamhf.Iphr*1.5, 128, 25, 100, 4);
+			
+		} else if (stricmp(mapmode, "lazy") == 0) {
+			// Same node spacing as the uniform map, but unbounded except
+			// for sanity limits. Grows to whatever the stimuli visit.
+			track_mlamhf.setLazyMap(
+				0,  track_mlamhf.Iphr*1.5/127, 25, 25,
+				0,  track_mlamhf.Iphr*4,      -60, 150
+			);
+			
+		} else if (stricmp(mapmode, "adaptive") == 0) {
+			// Same area as the uniform map, nodes only where needed.
+			track_mlamhf.setAdaptiveMap(0, track_mlamhf.Iphr*1.5, 25, 100, 0.01);
+			
+		} else if (stricmp(mapmode, "poly") == 0) {
+			// Below 5% of Iphr the fit holds its edge value.
+			track_mlamhf.setSurrogate(track_mlamhf.Iphr*0.05, track_mlamhf.Iphr*1.5, 25, 100);
+			if (track_mlamhf) {
+				auto s = track_mlamhf.getSurrogate();
+				cout<<"MLAM fit error "<<s->maxError()*1e3<<" mV max, "<<s->rmsError()*1e3<<" mV rms... "<<flush;
+			}
+			
+		} else {
+			cout << "Error." << endl;
+			cerr << "Error: Unknown MLAM map type \"" << mapmode << "\"." << endl;
+			return 1;
+		}
 		if (!track_mlamhf) {
 			cout<<"Error."<<endl;
 			cerr<<"Error: Failed to configure MPPT trackers."<<endl;
 			return 1;
 		}
+		
+		// Adaptation learns from where the heuristic part settles, so it
+		// needs IncCond, real temperatures, and a uniform map to refresh.
+		if (iAdapt) {
+			if (tracker != &tracker_mlamhf || track_mlamhf.dVr == 0) {
+				cout<<"Error."<<endl;
+				cerr<<"Error: --adapt requires an mlam+ic tracker with temperature."<<endl;
+				return 1;
+			}
+			adapter = new mlam_adapter(track_mlamhf);
+			d.add(destroy_adapter, 0);
+			if (!adapter->start()) {
+				cout<<"Error."<<endl;
+				cerr<<"Error: --adapt requires --mlam-map uniform."<<endl;
+				return 1;
+			}
+		}
 	}
 	cout<<"Ok."<<endl;
 	
 	// Output file creation (automatically truncated! be aware!)
 	if (iOutFile) {
 		cout<<"Creating data file... "<<flush;
-		outFile.open(argv[iOutFile], ios::out|ios::trunc);
-		if (!outFile) {
+		const char *header = iGeneratorTest ? "  Time V1 V2 I1 I2" : "  Time G T1 T2 V1 V2 Vr1 Vr2 I1 I2 P1 P2";
+		if (iStimuli || iBench) {
+			outFile.open(argv[iOutFile], ios::out|ios::trunc);
+			if (outFile) outFile << header << endl << setprecision(15) << dec;
+		} else {
+			// The control thread only queues samples, a thread of its
+			// own writes them.
+			if (logger.open(argv[iOutFile], header)) d.add(close_logger, 0);
+		}
+		if (!outFile.is_open() && !logger) {
 			cout<<"Error!"<<endl;
 			cerr<<"Failed to create output file \""<<argv[iOutFile]<<"\"."<<endl;
 			return 1;
 		}
-		
-		// Output file header
-		time_t rawtime;
-		struct tm *timeinfo;
-		time ( &rawtime );
-		timeinfo = localtime ( &rawtime );
-		
-		if (!iGeneratorTest) {
-			outFile << "  Time G T1 T2 V1 V2 Vr1 Vr2 I1 I2 P1 P2" << endl;
-		} else {
-			outFile << "  Time V1 V2 I1 I2" << endl;
-		}
-		outFile << setprecision(15) << dec;
 		cout<<"Ok."<<endl;
 	}
 	
-	// Simulation run
-	if (iStimuli) {
-		// Load stimuli
-		cout<<"Loading stimuli... "<<flush;
-		std::map<std::string, std::vector<double> > stimuli = load_dat(argv[iStimuli]);
-		if (stimuli.empty()) {
-			cout<<"Failed."<<endl;
-			cerr<<"Stimuli file empty, invalid, or inexinstent."<<endl;
-			return 1;
+	// Simulation run, over a stimuli file, or with --bench over the
+	// synthetic year.
+	if (iStimuli || iBench) {
+		std::map<std::string, std::vector<double> > stimuli;
+		int days = 1;
+		if (iBench) {
+			days = 365;
+			if (iBenchDays) {
+				days = strIsInt(argv[iBenchDays]) ? atoi(argv[iBenchDays]) : -1;
+				if (days < 1 || days > 365) {
+					cerr<<"Error: --bench-days requires an integer from 1 to 365."<<endl;
+					return 1;
+				}
+			}
+			cout<<"Synthetic year, "<<days<<" days... "<<flush;
+		} else {
+			// Load stimuli
+			cout<<"Loading stimuli... "<<flush;
+			stimuli = load_dat(argv[iStimuli]);
+			if (stimuli.empty()) {
+				cout<<"Failed."<<endl;
+				cerr<<"Stimuli file empty, invalid, or inexinstent."<<endl;
+				return 1;
+			}
+			if (
+				stimuli["Time"].empty() ||
+				stimuli["G"].empty() ||
+				stimuli["T"].empty()
+			) {
+				cout<<"Failed."<<endl;
+				cerr<<"Stimuli file does not contain required variables Time, G and/or T."<<endl;
+				return 1;
+			}
 		}
-		if (
-			stimuli["Time"].empty() ||
-			stimuli["G"].empty() ||
-			stimuli["T"].empty()
-		) {
-			cout<<"Failed."<<endl;
-			cerr<<"Stimuli file does not contain required variables Time, G and/or T."<<endl;
-			return 1;
+		
+		// Partial shading, the first cells see Gs instead of G. The
+		// synthetic year shades them to --shade-level of G, 30% by default.
+		int shaded = 0;
+		double shadeLevel = 0.3;
+		if (iShadedCells) {
+			shaded = strIsInt(argv[iShadedCells]) ? atoi(argv[iShadedCells]) : -1;
+			if (shaded < 0 || shaded > genparam->model.Ns) {
+				cout<<"Failed."<<endl;
+				cerr<<"Error: --shaded-cells requires an integer from 0 to "<<genparam->model.Ns<<"."<<endl;
+				return 1;
+			}
+			if (!iBench && stimuli["Gs"].size() < stimuli["Time"].size()) {
+				cout<<"Failed."<<endl;
+				cerr<<"Stimuli file does not contain variable Gs, required by --shaded-cells."<<endl;
+				return 1;
+			}
+		}
+		if (iShadeLevel) {
+			shadeLevel = strIsFloat(argv[iShadeLevel]) ? atof(argv[iShadeLevel]) : -1;
+			if (!iBench || !(shadeLevel >= 0 && shadeLevel <= 1)) {
+				cout<<"Failed."<<endl;
+				cerr<<"Error: --shade-level requires --bench, and a fraction of G from 0 to 1."<<endl;
+				return 1;
+			}
 		}
 		cout<<"Ok."<<endl;
+		if (iBench && shaded) cout<<"Shading: "<<shaded<<" cells at "<<100*shadeLevel<<"% of G."<<endl;
 		
-		// Prepare generator model (use experimental model)
+		// Prepare generator model (use experimental model). Shading needs
+		// one model per cell, with bypass diodes.
 		cout<<"Preparing PV generator model ("<<genparam->name<<")... "<<flush;
-		pvGenerator_sc gen;
+		pvGenerator_sc gen_sc;
+		pvGenerator_mc gen_mc;
+		pvGenerator &gen = shaded ? (pvGenerator&)gen_mc : (pvGenerator&)gen_sc;
 		pvgen_setup(gen, genparam->model);
+		if (shaded) gen_mc.setBypass(bypass);
 		cout<<"Ok."<<endl;
 		
-		// Run
+		// Run, a day at a time for the synthetic year
 		std::vector<double> &Time = stimuli["Time"];
 		std::vector<double> &G    = stimuli["G"];
 		std::vector<double> &T    = stimuli["T"];
+		std::vector<double> &Gs   = stimuli["Gs"];
 		double V0=0.5, I0, W0=0, P0a=0; // For True-MPP
 		double V1=0.5, I1, W1=0, P1a=0; // For IncCond
 		double V2=0.5, I2, W2=0, P2a=0; // For second tracker
+		double Ta = 0;  // Time of the previous step
+		long steps = 0;
+		
+		// Benchmark counters, TSC cycles
+		timestamp cMpp = 0, cSolve = 0, cTrk1 = 0, cTrk2 = 0, c0;
+		long nSolve = 0;
 		
-		progressBar pgb(Time.size());
+		progressBar pgb(iBench ? uint32_t(days)*SYNTH_DAY_STEPS/2 : Time.size()); // About half are daylight
 		cout<<"Running simulation... "<<endl;
-		for (int i=0; i<Time.size(); ++i) {
-			cout<<pgb(i);
-			gen.setInsolation(G[i]);
-			double TK = (T[i] > 200) ? T[i] : T[i] + 273.16;
-			gen.setTemperature(TK); // Already KELVIN
-			
-			// True MPP
-			double P0, Vr0;
-			I0 = gen.I(Vr0);
-			P0 = V0 * I0;
-			I0 = pvgen_mpp_I(gen, 0.0, gen.getSourceCurrent(), 1e-4);
-			Vr0 = gen.V(I0);
-			
-			// IncCond
-			I1 = gen.I(V1);
-			double P1 = V1*I1;
-			double Vr1 = track_ic(V1, I1);
-			
-			// Second tracker
-			double P2, Vr2;
-			I2 = gen.I(V2);
-			P2 = V2*I2;
-			Vr2 = tracker(gen, V2, I2, TK);
-			
-			// Saving
-			if (outFile)
-				outFile
-					<< Time[i] << " "
-					<< G[i] << " "
-					<< T[i] << " "
-					<< T[i] << " "
-					<< V1   << " "
-					<< V2   << " "
-					<< Vr1  << " "
-					<< Vr2  << " "
-					<< I1   << " "
-					<< I2   << " "
-					<< P1   << " "
-					<< P2   << endl;
-			
-			if (i) {
-				if (!skip_boot || Time[i] > 100) {
-					W0 += (Time[i]-Time[i-1]) * (P0+P0a)/2;
-					W1 += (Time[i]-Time[i-1]) * (P1+P1a)/2;
-					W2 += (Time[i]-Time[i-1]) * (P2+P2a)/2;
+		double wall = getTime();
+		for (int day=0; day<days; ++day) {
+			if (iBench) {
+				synth_day(day, Time, G, T);
+				Gs.resize(G.size());
+				for (size_t i=0; i<G.size(); ++i) Gs[i] = G[i]*shadeLevel;
+			}
+			for (size_t i=0; i<Time.size(); ++i, ++steps) {
+				cout<<pgb(steps);
+				gen.setInsolation(G[i]);
+				double TK = (T[i] > 200) ? T[i] : T[i] + 273.16;
+				gen.setTemperature(TK); // Already KELVIN
+				for (int c=0; c<shaded; ++c) gen_mc.setInsolation(c, Gs[i]);
+				
+				// True MPP, the global one when shaded
+				double P0;
+				c0 = read_timestamp_counter();
+				SOLVER_AT("true MPP",
+					if (shaded) I0 = pvgen_gmpp_I(gen, 0.0, gen.getSourceCurrent(), 1e-4);
+					else        I0 = pvgen_mpp_I(gen, 0.0, gen.getSourceCurrent(), 1e-4);
+				);
+				cMpp += read_timestamp_counter() - c0;
+				c0 = read_timestamp_counter();
+				SOLVER_AT("true MPP", V0 = gen.V(I0));
+				cSolve += read_timestamp_counter() - c0;
+				P0 = V0 * I0;
+				
+				// IncCond
+				c0 = read_timestamp_counter();
+				SOLVER_AT("IncCond plant", I1 = gen.I(V1));
+				cSolve += read_timestamp_counter() - c0;
+				double P1 = V1*I1;
+				c0 = read_timestamp_counter();
+				double Vr1 = track_ic(V1, I1);
+				cTrk1 += read_timestamp_counter() - c0;
+				
+				// Second tracker
+				double P2, Vr2;
+				c0 = read_timestamp_counter();
+				SOLVER_AT("tracker plant", I2 = gen.I(V2));
+				cSolve += read_timestamp_counter() - c0;
+				nSolve += 3;
+				P2 = V2*I2;
+				c0 = read_timestamp_counter();
+				Vr2 = tracker(gen, V2, I2, TK);
+				if (adapter) track_mlamhf.Vr -= (*adapter)(V2, I2, TK-273.16);
+				cTrk2 += read_timestamp_counter() - c0;
+				
+				// Saving
+				if (outFile)
+					outFile
+						<< Time[i] << " "
+						<< G[i] << " "
+						<< T[i] << " "
+						<< T[i] << " "
+						<< V1   << " "
+						<< V2   << " "
+						<< Vr1  << " "
+						<< Vr2  << " "
+						<< I1   << " "
+						<< I2   << " "
+						<< P1   << " "
+						<< P2   << endl;
+				
+				if (steps && !(iBench && i == 0)) { // Not over synthetic nights
+					if (!skip_boot || Time[i] > 100) {
+						W0 += (Time[i]-Ta) * (P0+P0a)/2;
+						W1 += (Time[i]-Ta) * (P1+P1a)/2;
+						W2 += (Time[i]-Ta) * (P2+P2a)/2;
+					}
 				}
+				V1 = Vr1;
+				V2 = Vr2;
+				P0a = P0;
+				P1a = P1;
+				P2a = P2;
+				Ta = Time[i];
 			}
-			V1 = Vr1;
-			V2 = Vr2;
-			P0a = P0;
-			P1a = P1;
-			P2a = P2;
 		}
+		wall = getTime() - wall;
 		
 		cout<<pgb()<<endl;
 		cout<<"Done."<<endl;
+		SOLVER_STATS_REPORT(cout);
+		if (iBench) {
+			struct rusage ru;
+			getrusage(RUSAGE_SELF, &ru);
+			double ns = 1e9/cpu_clock();
+			cout<<"Throughput ("<<steps<<" steps in "<<wall<<"s):"<<endl;
+			cout<<"  "<<steps/wall<<" steps/s, "<<1e9*wall/steps<<" ns/step"<<endl;
+			cout<<"  IncCond step:   "<<cTrk1*ns/steps<<" ns"<<endl;
+			cout<<"  Tracker step:   "<<cTrk2*ns/steps<<" ns ("<<(iTracker ? argv[iTracker] : "mlam+ic")<<")"<<endl;
+			cout<<"  Generator solve: "<<cSolve*ns/nSolve<<" ns ("<<nSolve<<" solves)"<<endl;
+			cout<<"  True MPP search: "<<cMpp*ns/steps<<" ns"<<endl;
+			cout<<"  Peak RSS: "<<ru.ru_maxrss/1024.<<" MiB"<<endl;
+		}
 		cout<<"Energy accumulated:"<<endl;
 		cout<<"  W0 = "<<W0<<"J ("<<(W0/W1*100)<<"%)"<<endl;
 		cout<<"  W1 = "<<W1<<"J (100.000%)"<< endl;
 		cout<<"  W2 = "<<W2<<"J ("<<(W2/W1*100)<<"%)"<<endl;
+		if (adapter) {
+			const mppt_mlam &e = adapter->estimate();
+			cout<<"Model adaptation:"<<endl;
+			cout<<"  "<<adapter->points()<<" points, "<<adapter->rejected()<<" rejected, "
+				<<adapter->maps()<<" maps, "<<adapter->rows()<<" rows rebuilt"<<endl;
+			cout<<"  mr = "<<track_mlamhf.mr<<" -> "<<e.mr<<endl;
+			cout<<"  Ior = "<<track_mlamhf.Ior<<" -> "<<e.Ior<<endl;
+			cout<<"  Rs = "<<track_mlamhf.Rs<<" -> "<<e.Rs<<endl;
+			cout<<"  Rp = "<<track_mlamhf.Rp<<" -> "<<e.Rp<<endl;
+		}
+		if (tracker == &tracker_gscan) {
+			const mppt_gscan_stats &st = track_gscan->stats;
+			double dt = (Time.back()-Time.front())/(Time.size()-1); // Same for every day
+			cout<<"Global search overhead:"<<endl;
+			cout<<"  "<<st.scans<<" searches, "<<st.moves<<" moved to another peak"<<endl;
+			cout<<"  "<<st.perturbations<<" perturbations ("<<(100.0*st.perturbations/st.steps)<<"% of steps), "
+				<<st.skipped<<" candidates pruned"<<endl;
+			cout<<"  "<<st.lost*dt<<"J lost while searching ("<<(st.lost*dt/W2*100)<<"%)"<<endl;
+		}
 		return 0;
 	}
 	
@@ -603,14 +901,9 @@ int main(int argc, const char *argv[]) {
 		cerr<<"Error: Failed setting up signal handler for SIGTERM."<<endl;
 		return 1;
 	}
-	if (signal(SIGALRM,alarm_handler) == SIG_ERR) {
-		cout<<"Error!"<<endl;
-		cerr<<"Error: Failed to install SIGALRM handler."<<endl;
-		return 1;
-	}
-	if (sem_init(&alarm_sem, 0, 1)) {
+	if (signal(SIGUSR1, report_handler) == SIG_ERR) {
 		cout<<"Error!"<<endl;
-		cerr<<"Error: Failed to create SIGALRM protection semaphore."<<endl;
+		cerr<<"Error: Failed setting up signal handler for SIGUSR1."<<endl;
 		return 1;
 	}
 	if (sem_init(&main_wait, 0, 1)) {
@@ -621,110 +914,195 @@ int main(int argc, const char *argv[]) {
 	d.add(remove_signal_handlers, 0);
 	cout<<"Ok."<<endl;
 	
-	// Set the alarm rate
-	cout<<"Setting sample period... "<<flush;
-	struct itimerval itv;
-	itv.it_interval.tv_sec  = unsigned(dSamplePeriod);
-	itv.it_interval.tv_usec = unsigned((dSamplePeriod - itv.it_interval.tv_sec) * 1000000);
-	itv.it_value.tv_sec     = 1;
-	itv.it_value.tv_usec    = 0;
-	if (setitimer(ITIMER_REAL,&itv, 0)) {
+	// One I/O thread per power supply, so their exchanges overlap
+	if (iConcurrentIo) {
+		cout<<"Starting the power supply I/O threads... "<<flush;
+		d.add(stop_psu_threads, 0);
+		if (!psu1_io.start(control.priority) || !psu2_io.start(control.priority)) {
+			cout<<"Error!"<<endl;
+			cerr<<"Error: Failed to start the power supply I/O threads: "<<strerror(errno)<<"."<<endl;
+			return 1;
+		}
+		cout<<"Ok."<<endl;
+	}
+	
+	if (iMlock) {
+		cout<<"Locking memory... "<<flush;
+		if (!rt_lock_memory()) {
+			cout<<"Error!"<<endl;
+			cerr<<"Error: mlockall failed: "<<strerror(errno)<<"."<<endl;
+			return 1;
+		}
+		cout<<"Ok."<<endl;
+	}
+	
+	// Start the control loop
+	cout<<"Starting the control loop... "<<flush;
+	telemetry.period = int64_t(dSamplePeriod*1e9 + 0.5);
+	startTime = getTime();
+	if (!control.start(control_tick, 0)) {
 		cout<<"Error!"<<endl;
-		cerr<<"Error: Failed to set the alarm rate."<<endl;
+		cerr<<"Error: Failed to start the control loop thread: "<<strerror(errno)<<"."<<endl;
+		if (iRtPrio || iCpu) cerr<<"SCHED_FIFO and CPU pinning may require root or CAP_SYS_NICE."<<endl;
 		return 1;
 	}
+	d.add(stop_control_loop, 0);
 	cout<<"Ok."<<endl;
 	
 	// Main loop
 	char lops[] = "/-\\|";
 	int lopn = 0;
 	progressBar pgb("Running", dDuration);
-	while (!interrupt_process) {
+	while (!interrupt_process && control.running()) {
 		cout<<pgb(getTime() - startTime);
 		
-		// Wait for a signal from the alarm handler
+		// Wait for a tick, or 0.1s at most. The timeout is absolute, on
+		// CLOCK_REALTIME.
 		struct timespec ts;
-		ts.tv_sec  = 0;
-		ts.tv_nsec = 100000000; //0.1s
-		if (sem_timedwait(&main_wait, &ts)) {
-			continue;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_nsec -= 1000000000;
+			++ts.tv_sec;
+		}
+		sem_timedwait(&main_wait, &ts);
+		
+		telemetry.collect();
+		if (report_requested) {
+			report_requested = false;
+			cerr<<endl;
+			telemetry.report(cerr);
 		}
 		
 //		cout<<"\rRunning... "<<lops[lopn++]<<flush;
 //		if (!lops[lopn]) lopn = 0;
 	}
+	control.stop();
 	cout<<pgb()<<endl;
 	
+	cout<<"Control loop: "<<control.ticks()<<" ticks, "<<control.overruns()<<" overruns, "
+		<<control.skipped()<<" skipped, worst start "<<1e3*control.maxLate()<<"ms late."<<endl;
+	telemetry.report(cout);
+	if (iOutFile) {
+		logger.close();
+		cout<<"Data file: "<<logger.records()<<" samples in "<<logger.writes()<<" writes, longest "
+			<<1e3*logger.maxWrite()<<"ms, "<<logger.dropped()<<" dropped."<<endl;
+		if (logger.error()) cerr<<"Error: Writing the data file failed, samples were lost."<<endl;
+	}
+	if (serial_log) cout<<"Serial log: "<<serial_log.records()<<" records so far, "<<serial_log.dropped()<<" dropped."<<endl;
+	if (sensor) cout<<"Sensors: "<<sensor.connects()<<" connections, "<<sensor.failures()<<" failed, "
+		<<sensor.stale()<<" stale readings."<<endl;
+	if (control.aborted()) {
+		cerr<<"Error: A tick overran the sample period, aborted. See --overrun."<<endl;
+		return 1;
+	}
+	
 	return 0;
 }
 
-void alarm_handler(int) {
+// --batch-io line for one supply: the setpoint left by the last tick, if
+// any, then the measurement. Returns the index of the voltage query, the
+// current one follows.
+static int batch_prepare(kepco_batch &b, double Vset, int digits) {
+	b.clear();
+	if (!isnan(Vset)) b.add("volt", Vset, digits);
+	int v = b.add("meas:volt?");
+	b.add("meas:curr?");
+	return v;
+}
+
+bool control_tick(void *) {
 	sem_post(&main_wait);
-	if (interrupt_process) return;
-	
-	// Check CPU overload
-	if (sem_trywait(&alarm_sem)) {
-		// Previous alarm has not finished processing
-		interrupt_process = true; // Abort
-		return;
-	}
+	if (interrupt_process) return false;
 	
-	// Time of day, of step, and of test
-	static double dt=NAN, fst=NAN;
-	double tod = getTime();
-	if (isnan(dt)) dt = 0;
-	else dt = tod - dt;
-	if (isnan(fst)) fst=tod;
-	double t = tod - startTime;
+	// Time of test, the tick interval is in the telemetry
+	telemetry.begin();
+	double t = getTime() - startTime;
 	
-	double G, T1, T2, V1, V2, I1, I2;
-	psu1.getVoltageAndCurrent(V1, I1);
-	psu2.getVoltageAndCurrent(V2, I2);
-	I1 *= -1; I2 *= -1;
-	if (!sensor.read(&G, &T1, &T2)) {
+	// With --concurrent-io both reads run at once, and PSU2 read is the
+	// wait past PSU1's. With --batch-io the setpoints of the last tick go
+	// out in the same line as the reads, right before them.
+	static double Vs1 = NAN, Vs2 = NAN; // Setpoints not sent yet, --batch-io
+	static double rV1 = 0, rV2 = 0, rI1 = 0, rI2 = 0; // Kept when a read fails
+	double G, T1, T2;
+	if (iBatchIo) {
+		int k1 = batch_prepare(psu1_batch, Vs1, psu1.precision);
+		int k2 = batch_prepare(psu2_batch, Vs2, psu2.precision);
+		if (iConcurrentIo) {
+			psu1_io.beginBatch(psu1_batch);
+			psu2_io.beginBatch(psu2_batch);
+			psu1_io.endBatch();
+			telemetry.lap(TICK_PSU1_READ);
+			psu2_io.endBatch();
+		} else {
+			psu1_batch.run(psu1);
+			telemetry.lap(TICK_PSU1_READ);
+			psu2_batch.run(psu2);
+		}
+		telemetry.lap(TICK_PSU2_READ);
+		double v;
+		if (!isnan(v = psu1_batch.value(k1)))   rV1 = v;
+		if (!isnan(v = psu1_batch.value(k1+1))) rI1 = v;
+		if (!isnan(v = psu2_batch.value(k2)))   rV2 = v;
+		if (!isnan(v = psu2_batch.value(k2+1))) rI2 = v;
+	} else if (iConcurrentIo) {
+		psu1_io.beginRead();
+		psu2_io.beginRead();
+		psu1_io.endRead(rV1, rI1);
+		telemetry.lap(TICK_PSU1_READ);
+		psu2_io.endRead(rV2, rI2);
+		telemetry.lap(TICK_PSU2_READ);
+	} else {
+		psu1.getVoltageAndCurrent(rV1, rI1);
+		telemetry.lap(TICK_PSU1_READ);
+		psu2.getVoltageAndCurrent(rV2, rI2);
+		telemetry.lap(TICK_PSU2_READ);
+	}
+	double V1 = rV1, I1 = -rI1, V2 = rV2, I2 = -rI2;
+	if (!sensor.read(&G, &T1, &T2) && isnan(G)) {
+		// No sensors, or no reading yet. Stale ones are kept.
 		G = 1000;
 		T1 = T2 = 40;
 	}
+	telemetry.lap(TICK_SENSOR_READ);
 		
 	if (!iGeneratorTest) {
 		// Tracking
 		double Vr1 = track_ic(V1, I1);
 	//	double Vr2 = track_ic(V2, I2);
 		double Vr2 = track_mlamhf(V2, I2, T2);
-		psu1.setVoltage(Vr1);
-		psu2.setVoltage(Vr2);
+		if (adapter) track_mlamhf.Vr -= (*adapter)(V2, I2, T2);
+		telemetry.lap(TICK_TRACKING);
+		if (iBatchIo) {
+			Vs1 = Vr1;
+			Vs2 = Vr2;
+		} else if (iConcurrentIo) {
+			psu1_io.beginSetVoltage(Vr1);
+			psu2_io.beginSetVoltage(Vr2);
+			psu1_io.endSetVoltage();
+			psu2_io.endSetVoltage();
+		} else {
+			psu1.setVoltage(Vr1);
+			psu2.setVoltage(Vr2);
+		}
+		telemetry.lap(TICK_PSU_WRITE);
 	
 		// Saving
-		if (outFile)
-			outFile
-				<< t  << " "
-				<< G  << " "
-				<< T1 << " "
-				<< T2 << " "
-				<< V1 << " "
-				<< V2 << " "
-				<< Vr1 << " "
-				<< Vr2 << " "
-				<< I1 << " "
-				<< I2 << " "
-				<< (V1*I1) << " "
-				<< (V2*I2) << endl;
+		if (logger) {
+			sample_record r = {12, {t, G, T1, T2, V1, V2, Vr1, Vr2, I1, I2, V1*I1, V2*I2}};
+			logger.push(r);
+		}
 	} else {
 		// Generator testing
 		// Just save data
-		if (outFile) outFile
-			<< t  << " "
-			<< V1 << " "
-			<< V2 << " "
-			<< I1 << " "
-			<< I2 << endl;
+		if (logger) {
+			sample_record r = {5, {t, V1, V2, I1, I2}};
+			logger.push(r);
+		}
 	}
-	
-	// Save time of day for this run, used to measure timestep.
-	dt = tod;
+	telemetry.lap(TICK_LOGGING);
+	telemetry.end();
 	
 	if (t>=dDuration) interrupt_process = true;
-	
-	// Mark processing as finished
-	sem_post(&alarm_sem);
+	return !interrupt_process;
 }
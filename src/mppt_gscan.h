@@ -0,0 +1,172 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef MPPT_GSCAN_H
+#define MPPT_GSCAN_H
+
+#include <cmath>
+#include "mppt_inccond.h"
+
+// Most candidate peaks a scan visits.
+#define GSCAN_MAXPEAKS 16
+
+// Global search overhead.
+struct mppt_gscan_stats {
+	long steps;         // Tracker steps
+	long scans;         // Global searches
+	long perturbations; // Steps spent away from the tracked peak, scanning
+	long skipped;       // Candidates pruned without a visit
+	long moves;         // Searches that moved to another peak
+	double lost;        // Power given up while scanning, summed over steps, W
+	mppt_gscan_stats() : steps(0), scans(0), perturbations(0), skipped(0), moves(0), lost(0) {}
+};
+
+// Global MPPT for partially shaded generators. With bypass diodes the P(V)
+// curve has up to one peak per diode, near multiples of the MPP voltage of
+// one bypass group, and IncCond locks onto whichever it climbs first. These
+// trackers run IncCond, and now and then spend one step on each candidate
+// peak, k*Vpeak for k = 1..npeaks, skipping the one being tracked. If one of
+// them yields more power than the tracked peak they move there, and IncCond
+// climbs the new peak.
+//
+// A candidate is only sampled, not climbed, so it has to beat the tracked
+// peak as sampled to win. That misses some peaks, but never moves back and
+// forth between two.
+//
+// mppt_gscan_periodic searches every period steps. mppt_gscan_adaptive only
+// searches when the power changes by more than trigger, as when shading
+// changes, or at most every period steps. Given the irradiance G, unshaded,
+// it follows P/G instead, so passing clouds, which scale the power with G,
+// start no search; P/G still strays while IncCond catches up with a fast
+// ramp, hence its 20% trigger. It also bounds the power of each candidate
+// before visiting it: currents fall as voltage rises, so no point above a
+// sampled one can draw more current. Candidates are visited upwards, and
+// skipped when their voltage times the last current seen can not beat the
+// best power found so far.
+struct mppt_gscan : public mppt_inccond {
+	double Vpeak;   // Candidate spacing, MPP voltage of a bypass group, V
+	int    npeaks;  // Candidates, bypass groups
+	int    period;  // Steps between searches, or the longest for adaptive ones
+	double trigger; // Relative power change that starts a search, 0 for none
+	bool   prune;   // Skip candidates that can not beat the best so far
+	double Imax;    // Current bound below the lowest sampled point, A. Grows to the largest seen.
+	mppt_gscan_stats stats;
+
+	mppt_gscan() : Vpeak(0), npeaks(0), period(1000), trigger(0), prune(false), Imax(0),
+		scanning(false), since(0), next(0), Sref(NAN) {}
+	double operator () (double V, double I, double G = NAN); // Calcula a tensão de referência
+
+	private:
+	bool scanning;
+	int since;                   // Steps since the last search
+	int next;                    // Next candidate to visit
+	double Vhome, Ihome, Phome;  // Tracked peak when the search started
+	double Vbest, Ibest, Pbest;  // Best point so far
+	double Ibound;               // Bound on current above the last sample
+	double Sref;                 // P or P/G after the last search, for the trigger
+
+	double nextCandidate();
+};
+
+struct mppt_gscan_periodic : public mppt_gscan {
+	mppt_gscan_periodic() {
+		period = 1000;
+	}
+};
+
+struct mppt_gscan_adaptive : public mppt_gscan {
+	mppt_gscan_adaptive() {
+		period  = 10000;
+		trigger = 0.2;
+		prune   = true;
+	}
+};
+
+// Sets up the next candidate to visit, or returns NAN when done.
+inline double mppt_gscan::nextCandidate() {
+	for (; next <= npeaks && next <= GSCAN_MAXPEAKS; ++next) {
+		double Vk = next*Vpeak;
+		if (fabs(Vk - Vhome) < Vpeak/2) continue; // The tracked peak
+
+		// The peak near Vk, if any, is below Vk + Vpeak/2.
+		double Ik = Vk > Vhome && Ihome < Ibound ? Ihome : Ibound;
+		if (prune && (Vk + Vpeak/2)*Ik <= Pbest) {
+			++stats.skipped;
+			continue;
+		}
+		return Vr = Vk;
+	}
+	return NAN;
+}
+
+inline double mppt_gscan::operator () (double V, double I, double G) {
+	++stats.steps;
+	double P = V*I;
+	double S = G > 0 ? P/G : P;
+	if (I > Imax) Imax = I;
+
+	if (scanning) {
+		// V and I are the answer to the candidate set last step.
+		++stats.perturbations;
+		if (Phome > P) stats.lost += Phome - P;
+		if (P > Pbest) {
+			Vbest = V;
+			Ibest = I;
+			Pbest = P;
+		}
+		if (I < Ibound) Ibound = I;
+		++next;
+		if (!std::isnan(nextCandidate())) return Vr;
+
+		// Done, back to IncCond one step below the best point, as
+		// IncCond holds still when nothing changes.
+		scanning = false;
+		if (Vbest != Vhome) ++stats.moves;
+		Va = Vbest;
+		Ia = Ibest;
+		Vr = Vbest - dVr;
+		Sref = NAN;
+		since = 0;
+		return Vr;
+	}
+
+	// Tracking
+	if (std::isnan(Sref)) Sref = S;
+	++since;
+	bool search = since >= period;
+	if (trigger > 0 && fabs(S - Sref) > trigger*Sref) search = true;
+	if (!search || npeaks < 2 || !(Vpeak > 0)) return mppt_inccond::operator() (V, I);
+
+	++stats.scans;
+	scanning = true;
+	Vhome = Vbest = V;
+	Ihome = Ibest = I;
+	Phome = Pbest = P;
+	Ibound = Imax;
+	next = 1;
+	if (!std::isnan(nextCandidate())) return Vr;
+
+	// All pruned
+	scanning = false;
+	Sref = S;
+	since = 0;
+	return mppt_inccond::operator() (V, I);
+}
+
+#endif
@@ -1,75 +1,287 @@
-/***************************************************************************
- *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
- *                                                                         *
- *   This program is free software; you can redistribute it and/or modify  *
- *   it under the terms of the GNU General Public License as published by  *
- *   the Free Software Foundation; either version 2 of the License, or     *
- *   (at your option) any later version.                                   *
- *                                                                         *
- *   This program is distributed in the hope that it will be useful,       *
- *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
- *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
- *   GNU General Public License for more details.                          *
- *                                                                         *
- *   You should have received a copy of the GNU General Public License     *
- *   along with this program; if not, write to the                         *
- *   Free Software Foundation, Inc.,                                       *
- *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
- ***************************************************************************/
-
-#include "mppt_mlam.h"
-#include <cmath>
-
-using namespace std;
-
-static const double q = 1.60217646e-19;
-static const double k = 1.3806503e-23;
-static const double e = 1.12;
-
-// Calcula a tensão sobre a curva Imax-Vmax
-static double map_builder_fcn (double I, double T, void *p) {
-	mppt_mlam *mppt  = (mppt_mlam *)p;
-	double Iphr = mppt->Iphr;
-	double mr   = mppt->mr;
-	double Rs   = mppt->Rs;
-	double Rp   = mppt->Rp;
-	double Ior  = mppt->Ior;
-	double Tr   = mppt->Tr;
-	int    Ns   = mppt->Ns;
-
-	double Vtr = k*(Tr+273.16)/q;
-	double Vt  = k*(T +273.16)/q;
-	double Io  = Ior*pow((T+273.16)/(Tr+273.16),3)*exp(e/(mr/Ns)*(1/Vtr-1/Vt));
-
-	// newton-raphson
-	double Vm, Vm1 = 10;
-	double a = 2;
-	for (int n=0; a >= 0.0000001 && n<10000; ++n) {
-		double F = -I + Io/(mr*Vt)*(Vm1-Rs*I)*exp((Vm1+Rs*I)/(mr*Vt)) + (Vm1-Rs*I)/Rp;
-		double DF = Io/(mr*Vt)*exp((Vm1+Rs*I)/(mr*Vt))*(1 + (Vm1-Rs*I)/(mr*Vt))+1/Rp;
-		Vm = Vm1 - F/DF;
-		a = abs(Vm - Vm1);
-		Vm1 = Vm;
-	}
-	return Vm;
-}
-
-void mppt_mlam::setMap(double minI, double maxI, int nI, double minT, double maxT, int nT) {
-	bil.setFunction(0,0);
-	
-	if (isnan(Iphr)) return;
-	if (isnan(mr  )) return;
-	if (isnan(Rs  )) return;
-	if (isnan(Rp  )) return;
-	if (isnan(Ior )) return;
-	if (isnan(Tr  )) return;
-	
-	bil.setX(minI,maxI,nI);
-	bil.setY(minT,maxT,nT);
-	bil.setFunction(map_builder_fcn, this);
-}
-
-mppt_mlam::mppt_mlam() {
-	Iphr = mr = Rs = Rp = Ior = Tr = NAN;
-	Ns = 36;
-}
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "mppt_mlam.h"
+#include "solver_stats.h"
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <stdint.h>
+#include <pthread.h>
+
+using namespace std;
+
+static const double q = 1.60217646e-19;
+static const double k = 1.3806503e-23;
+static const double e = 1.12;
+
+// Model parameters the maps are built from. Maps may outlive the tracker
+// that set them up, so builders get a copy instead of the tracker itself.
+struct mlam_model {
+	double Iphr, mr, Rs, Rp, Ior, Tr;
+	int Ns;
+};
+
+// Saturation current at T, in Celsius.
+static double diode_Io(const mlam_model *mppt, double T) {
+	double Vtr = k*(mppt->Tr+273.16)/q;
+	double Vt  = k*(T +273.16)/q;
+	return mppt->Ior*pow((T+273.16)/(mppt->Tr+273.16),3)*exp(e/(mppt->mr/mppt->Ns)*(1/Vtr-1/Vt));
+}
+
+// MPP locus equation, F(V,I) = 0, and its derivative on V.
+static inline void locus_fcn(double V, double I, double Io, double mVt, double Rs, double Rp, double &F, double &DF) {
+	F  = -I + Io/mVt*(V-Rs*I)*exp((V+Rs*I)/mVt) + (V-Rs*I)/Rp;
+	DF = Io/mVt*exp((V+Rs*I)/mVt)*(1 + (V-Rs*I)/mVt)+1/Rp;
+}
+
+// Version of map_builder_fcn and locus_fcn, part of the key of cached maps.
+// Bump it whenever either changes the numbers they give.
+#define MLAM_BUILDER_VERSION 2
+
+// Calcula a tensão sobre a curva Imax-Vmax
+static double map_builder_fcn (double I, double T, double guess, void *p) {
+	const mlam_model *mppt = (const mlam_model *)p;
+	double mr   = mppt->mr;
+	double Rs   = mppt->Rs;
+	double Rp   = mppt->Rp;
+	
+	double Vt  = k*(T +273.16)/q;
+	double Io  = diode_Io(mppt, T);
+	
+	// newton-raphson
+	SOLVER_CALL(SOLVER_MLAM_MAP);
+	double Vm, Vm1 = isnan(guess) ? 10 : guess;
+	double a = 2;
+	int n;
+	for (n=0; a >= 0.0000001 && n<10000; ++n) {
+		double F, DF;
+		locus_fcn(Vm1, I, Io, mr*Vt, Rs, Rp, F, DF);
+		Vm = Vm1 - F/DF;
+		// F is convex, so from below the root Newton overshoots. At low
+		// temperatures that overflows exp(), limit the upward step.
+		if (Vm > Vm1 + 2*mr*Vt) Vm = Vm1 + 2*mr*Vt;
+		a = abs(Vm - Vm1);
+		Vm1 = Vm;
+	}
+	SOLVER_DONE(n, a < 0.0000001);
+	return Vm;
+}
+
+#define MAP_KEY_SIZE 14
+
+// Maps already built, by builder version, model parameters and grid. Entries are weak, so a
+// map is freed once the last tracker using it goes away.
+struct map_key {
+	double v[MAP_KEY_SIZE];
+	bool operator < (const map_key &o) const {
+		return lexicographical_compare(v, v+MAP_KEY_SIZE, o.v, o.v+MAP_KEY_SIZE);
+	}
+};
+static std::map<map_key, std::weak_ptr<const bilinear_interpolator> > map_registry;
+static pthread_mutex_t map_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Maps are also cached on disk, one file per key, named after its hash.
+static const char *cache_env = getenv("MPPT_MAP_CACHE");
+static std::string cache_dir = cache_env ? cache_env : "";
+
+void mppt_mlam::setCacheDir(const char *dir) {
+	pthread_mutex_lock(&map_registry_lock);
+	cache_dir = dir ? dir : "";
+	pthread_mutex_unlock(&map_registry_lock);
+}
+
+static std::string cache_file(const map_key &key) {
+	// 64-bit FNV-1a
+	uint64_t h = 0xcbf29ce484222325ULL;
+	const unsigned char *b = (const unsigned char *)key.v;
+	for (size_t i=0; i<sizeof(key.v); ++i) {
+		h ^= b[i];
+		h *= 0x100000001b3ULL;
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "/mlam-%016llx.map", (unsigned long long)h);
+	return cache_dir + name;
+}
+
+bool mppt_mlam::hasModel() const {
+	if (isnan(Iphr)) return false;
+	if (isnan(mr  )) return false;
+	if (isnan(Rs  )) return false;
+	if (isnan(Rp  )) return false;
+	if (isnan(Ior )) return false;
+	if (isnan(Tr  )) return false;
+	return true;
+}
+
+void mppt_mlam::setMap(double minI, double maxI, int nI, double minT, double maxT, int nT) {
+	bil.reset();
+	lazy.reset();
+	adapt.reset();
+	poly.reset();
+	if (!hasModel()) return;
+	
+	mlam_model model = { Iphr, mr, Rs, Rp, Ior, Tr, Ns };
+	map_key key = {{ MLAM_BUILDER_VERSION, Iphr, mr, Ior, Rs, Rp, Tr, double(Ns), minI, maxI, double(nI), minT, maxT, double(nT) }};
+	
+	// The lock is held while building, so identical trackers set up
+	// concurrently wait for a single build instead of racing.
+	pthread_mutex_lock(&map_registry_lock);
+	bil = map_registry[key].lock();
+	if (!bil) {
+		std::shared_ptr<bilinear_interpolator> m(new bilinear_interpolator);
+		std::string fn = cache_dir.empty() ? "" : cache_file(key);
+		if (fn.empty() || !m->load(fn.c_str(), key.v, MAP_KEY_SIZE)) {
+			m->setX(minI,maxI,nI);
+			m->setY(minT,maxT,nT);
+			m->setFunction(map_builder_fcn, &model);
+			m->build();
+			if (*m && !fn.empty()) m->save(fn.c_str(), key.v, MAP_KEY_SIZE);
+		}
+		m->dropFunction(); // Shared maps outlive model
+		if (*m) {
+			bil = m;
+			map_registry[key] = bil;
+		}
+		
+		// Drop entries of maps nobody uses anymore
+		for (auto i = map_registry.begin(); i != map_registry.end(); ) {
+			if (i->second.expired()) map_registry.erase(i++);
+			else ++i;
+		}
+	}
+	pthread_mutex_unlock(&map_registry_lock);
+}
+
+// Lazy maps build nodes long after setLazyMap() returns, so they carry their
+// own copy of the model.
+struct mlam_lazy_map : public bilinear_lazy {
+	mlam_model model;
+};
+
+void mppt_mlam::setLazyMap(double I0, double dI, double T0, double dT, double minI, double maxI, double minT, double maxT) {
+	bil.reset();
+	lazy.reset();
+	adapt.reset();
+	poly.reset();
+	if (!hasModel()) return;
+	
+	std::shared_ptr<mlam_lazy_map> m(new mlam_lazy_map);
+	m->model = { Iphr, mr, Rs, Rp, Ior, Tr, Ns };
+	m->setGrid(I0, dI, T0, dT);
+	m->setLimits(minI, maxI, minT, maxT);
+	m->setFunction(map_builder_fcn, &m->model);
+	lazy = m;
+}
+
+// Near the MPP the power lost to a voltage error dV grows as I*dV^2, so the
+// error allowed on the map shrinks as 1/sqrt(I), from tol at I = Iphr.
+static double map_weight_fcn (double I, double /*T*/, void *p) {
+	const mlam_model *mppt = (const mlam_model *)p;
+	return I > 0 ? sqrt(I/mppt->Iphr) : 0;
+}
+
+void mppt_mlam::setAdaptiveMap(double minI, double maxI, double minT, double maxT, double tol, int maxNodes) {
+	bil.reset();
+	lazy.reset();
+	adapt.reset();
+	poly.reset();
+	if (!hasModel()) return;
+	
+	// The model is only used while building.
+	mlam_model model = { Iphr, mr, Rs, Rp, Ior, Tr, Ns };
+	std::shared_ptr<bilinear_adaptive> m(new bilinear_adaptive);
+	m->setX(minI, maxI);
+	m->setY(minT, maxT);
+	m->setFunction(map_builder_fcn, &model, map_weight_fcn);
+	m->build(tol, maxNodes);
+	if (*m) adapt = m;
+}
+
+// The locus is close to logarithmic in I, so the fit is against log(I).
+void mppt_mlam::setSurrogate(double minI, double maxI, double minT, double maxT, int degI, int degT) {
+	bil.reset();
+	lazy.reset();
+	adapt.reset();
+	poly.reset();
+	if (!hasModel()) return;
+	
+	mlam_model model = { Iphr, mr, Rs, Rp, Ior, Tr, Ns };
+	std::shared_ptr<poly_surrogate> m(new poly_surrogate);
+	m->setX(minI, maxI);
+	m->setY(minT, maxT);
+	m->setFunction(map_builder_fcn, &model);
+	if (m->fit(degI, degT, true)) poly = m;
+}
+
+double mppt_mlam::exact(double I, double T) const {
+	mlam_model model = { Iphr, mr, Rs, Rp, Ior, Tr, Ns };
+	return map_builder_fcn(I, T, NAN, &model);
+}
+
+double mppt_mlam::locus(double V, double I, double T, double *dFdV) const {
+	mlam_model model = { Iphr, mr, Rs, Rp, Ior, Tr, Ns };
+	double F, DF;
+	locus_fcn(V, I, diode_Io(&model, T), mr*k*(T+273.16)/q, Rs, Rp, F, DF);
+	if (dFdV) *dFdV = DF;
+	return F;
+}
+
+// Rows are probed at this many nodes before deciding to rebuild them.
+#define REFRESH_PROBES 8
+
+mppt_mlam::map_ptr mppt_mlam::refreshMap(const map_ptr &m, double tol, int *rows) const {
+	if (rows) *rows = 0;
+	if (!m || !*m || !hasModel()) return m;
+	
+	mlam_model model = { Iphr, mr, Rs, Rp, Ior, Tr, Ns };
+	std::shared_ptr<bilinear_interpolator> copy;
+	int nx = m->sizeX();
+	for (int iy=0; iy<m->sizeY(); ++iy) {
+		bool stale = false;
+		double T = m->nodeY(iy);
+		for (int j=0; j<REFRESH_PROBES && !stale; ++j) {
+			int ix = 1 + j*(nx-2)/(REFRESH_PROBES-1);
+			double old = m->node(ix, iy);
+			stale = !(fabs(map_builder_fcn(m->nodeX(ix), T, old, &model) - old) <= tol);
+		}
+		if (!stale) continue;
+		
+		if (!copy) copy.reset(new bilinear_interpolator(*m));
+		if (!*copy || !copy->rebuildRow(iy, map_builder_fcn, &model)) return m;
+		if (rows) ++*rows;
+	}
+	return copy ? map_ptr(copy) : m;
+}
+
+size_t mppt_mlam::memory() const {
+	if (bil)   return bil->memory();
+	if (adapt) return adapt->memory();
+	if (poly)  return poly->memory();
+	if (lazy)  return lazy->memory();
+	return 0;
+}
+
+mppt_mlam::mppt_mlam() {
+	Iphr = mr = Rs = Rp = Ior = Tr = NAN;
+	Ns = 36;
+}
@@ -1,45 +1,105 @@
-/***************************************************************************
- *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
- *                                                                         *
- *   This program is free software; you can redistribute it and/or modify  *
- *   it under the terms of the GNU General Public License as published by  *
- *   the Free Software Foundation; either version 2 of the License, or     *
- *   (at your option) any later version.                                   *
- *                                                                         *
- *   This program is distributed in the hope that it will be useful,       *
- *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
- *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
- *   GNU General Public License for more details.                          *
- *                                                                         *
- *   You should have received a copy of the GNU General Public License     *
- *   along with this program; if not, write to the                         *
- *   Free Software Foundation, Inc.,                                       *
- *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
- ***************************************************************************/
-
-#ifndef MPPT_MLAM_H
-#define MPPT_MLAM_H
-
-#include <bilinear.h>
-
-struct mppt_mlam {
-	private:
-	bilinear_interpolator bil;
-	
-	public:
-	// Parâmetros para G=1000W/m^2
-	double Iphr; // Corrente fotovoltaica
-	double mr;   // Fator de Idealidade do diodo
-	double Rs;   // Resistência série equivalente do gerador
-	double Rp;   // Resistência paralela equivalente do gerador
-	double Ior;  // Corrente do diodo
-	double Tr;   // Temperatura de referência
-	int    Ns;   // N[umero de células em série
-	double operator () (double I, double T) const { return bil(I,T); } // Calcula a tensão de referência
-	
-	void setMap(double minI, double maxI, int nI, double minT, double maxT, int nT);
-	operator bool() const { return bil; }
-	mppt_mlam();
-};
-
-#endif
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef MPPT_MLAM_H
+#define MPPT_MLAM_H
+
+#include <memory>
+#include <cmath>
+#include <bilinear.h>
+#include <bilinear_lazy.h>
+#include <bilinear_adaptive.h>
+#include <poly_surrogate.h>
+
+// The V(I,T) map is immutable once built and shared by every tracker with the
+// same model parameters and grid, so copying a tracker is cheap and trackers on
+// different threads may look it up concurrently.
+struct mppt_mlam {
+	typedef std::shared_ptr<const bilinear_interpolator> map_ptr;
+	
+	private:
+	map_ptr bil;
+	std::shared_ptr<const bilinear_lazy> lazy;
+	std::shared_ptr<const bilinear_adaptive> adapt;
+	std::shared_ptr<const poly_surrogate> poly;
+	
+	bool hasModel() const;
+	
+	public:
+	// Parâmetros para G=1000W/m^2
+	double Iphr; // Corrente fotovoltaica
+	double mr;   // Fator de Idealidade do diodo
+	double Rs;   // Resistência série equivalente do gerador
+	double Rp;   // Resistência paralela equivalente do gerador
+	double Ior;  // Corrente do diodo
+	double Tr;   // Temperatura de referência
+	int    Ns;   // N[umero de células em série
+	double operator () (double I, double T) const { // Calcula a tensão de referência
+		if (bil)  return (*bil)(I,T);
+		if (adapt) return (*adapt)(I,T);
+		if (poly)  return (*poly)(I,T);
+		if (lazy) return (*lazy)(I,T);
+		return 0;
+	}
+	
+	// Uniform map, built in full and shared with identical trackers.
+	void setMap(double minI, double maxI, int nI, double minT, double maxT, int nT);
+	map_ptr getMap() const { return bil; }
+	
+	// Lazy map with nodes every dI and dT, starting at I0 and T0. Only the
+	// tiles the tracker visits get built, and the map grows to follow the
+	// queries, clamped to [minI,maxI]x[minT,maxT].
+	void setLazyMap(double I0, double dI, double T0, double dT,
+		double minI=0, double maxI=HUGE_VAL, double minT=-HUGE_VAL, double maxT=HUGE_VAL);
+	std::shared_ptr<const bilinear_lazy> getLazyMap() const { return lazy; }
+	
+	// Non-uniform map over [minI,maxI]x[minT,maxT], with nodes placed so the
+	// interpolation error stays below tol volts at Iphr, and tol*sqrt(Iphr/I)
+	// at lower currents, using at most maxNodes.
+	void setAdaptiveMap(double minI, double maxI, double minT, double maxT, double tol, int maxNodes=4096);
+	std::shared_ptr<const bilinear_adaptive> getAdaptiveMap() const { return adapt; }
+	
+	// Polynomial of degree degI in log(I) and degT in T, fitted over
+	// [minI,maxI]x[minT,maxT], minI > 0. No table at all, check the fit error
+	// through getSurrogate().
+	void setSurrogate(double minI, double maxI, double minT, double maxT, int degI=4, int degT=2);
+	std::shared_ptr<const poly_surrogate> getSurrogate() const { return poly; }
+	
+	// Exact value the maps approximate, and the memory the current map uses.
+	double exact(double I, double T) const;
+	size_t memory() const;
+	
+	// MPP locus equation, zero on the locus, and its derivative on V.
+	double locus(double V, double I, double T, double *dFdV=0) const;
+	
+	// For online model updates. refreshMap() returns a copy of the uniform map
+	// m with the rows that deviate from this tracker's model by more than tol
+	// rebuilt, or m itself if none do. swapMap() exchanges the uniform map in
+	// use with m, so the old one may be released elsewhere.
+	map_ptr refreshMap(const map_ptr &m, double tol, int *rows=0) const;
+	void swapMap(map_ptr &m) { bil.swap(m); }
+	
+	// Directory for the persistent map cache, or 0 to disable it. Defaults to
+	// the MPPT_MAP_CACHE environment variable.
+	static void setCacheDir(const char *dir);
+	operator bool() const { return (bil && *bil) || (adapt && *adapt) || (poly && *poly) || (lazy && *lazy); }
+	mppt_mlam();
+};
+
+#endif
@@ -0,0 +1,49 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef MPPT_MLAM_EMBEDDED_H
+#define MPPT_MLAM_EMBEDDED_H
+
+#include "bilinear_table.h"
+#include "mppt_inccond.h"
+
+// MLAM and MLAM+IncCond on the numeric type real, for embedded targets. The
+// model lives on the host: the map is built there by mppt_mlam, in double
+// precision, and only its node table is carried over, either converted at
+// run time or exported as a C header by mlam2h.
+template <typename real>
+struct mppt_mlam_embedded {
+	bilinear_table<real> map;
+	mppt_mlam_embedded() {}
+	explicit mppt_mlam_embedded(const bilinear_table<real> &m) : map(m) {}
+	real operator () (real I, real T) const { return map(I,T); } // Calcula a tensão de referência
+	operator bool () const { return map; }
+};
+
+template <typename real>
+struct mppt_mlamhf_embedded : public mppt_mlam_embedded<real>, public mppt_inccond_t<real> {
+	mppt_mlamhf_embedded() {}
+	explicit mppt_mlamhf_embedded(const bilinear_table<real> &m) : mppt_mlam_embedded<real>(m) {}
+	real operator() (real V, real I, real T) {
+		return mppt_mlam_embedded<real>::operator() (I,T)
+		  + mppt_inccond_t<real>::operator() (V,I);
+	}
+};
+
+#endif
@@ -1,32 +1,35 @@
-/***************************************************************************
- *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
- *                                                                         *
- *   This program is free software; you can redistribute it and/or modify  *
- *   it under the terms of the GNU General Public License as published by  *
- *   the Free Software Foundation; either version 2 of the License, or     *
- *   (at your option) any later version.                                   *
- *                                                                         *
- *   This program is distributed in the hope that it will be useful,       *
- *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
- *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
- *   GNU General Public License for more details.                          *
- *                                                                         *
- *   You should have received a copy of the GNU General Public License     *
- *   along with this program; if not, write to the                         *
- *   Free Software Foundation, Inc.,                                       *
- *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
- ***************************************************************************/
-
-#ifndef MPPT_TEMPERATURE_H
-#define MPPT_TEMPERATURE_H
-
-struct mppt_temperature {
-	double Vmpref, Tref; // Mpp voltage under reference temperature, and reference temperature.
-	double kVT; // Temperature coefficient V/K
-	mppt_temperature() : Vmpref(0), Tref(0), kVT(0) {}
-	double operator () (double T) {
-		return Vmpref + kVT * (T-Tref);
-	}
-};
-
-#endif
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef MPPT_TEMPERATURE_H
+#define MPPT_TEMPERATURE_H
+
+template <typename real>
+struct mppt_temperature_t {
+	real Vmpref, Tref; // Mpp voltage under reference temperature, and reference temperature.
+	real kVT; // Temperature coefficient V/K
+	mppt_temperature_t() : Vmpref(0), Tref(0), kVT(0) {}
+	real operator () (real T) {
+		return Vmpref + kVT * (T-Tref);
+	}
+};
+
+typedef mppt_temperature_t<double> mppt_temperature;
+
+#endif
@@ -22,10 +22,11 @@
 #include "mppt_temperature.h"
 #include "mppt_inccond.h"
 
-struct mppt_temperaturehf : public mppt_temperature, public mppt_inccond {
-	double operator() (double V, double I, double T) {
-		return mppt_temperature::operator() (T) 
-		         + mppt_inccond::operator() (V,I);
+template <typename real>
+struct mppt_temperaturehf_t : public mppt_temperature_t<real>, public mppt_inccond_t<real> {
+	real operator() (real V, real I, real T) {
+		return mppt_temperature_t<real>::operator() (T) 
+		         + mppt_inccond_t<real>::operator() (V,I);
 	}
 	
 	private:
@@ -33,4 +34,6 @@ struct mppt_temperaturehf : public mppt_temperature, public mppt_inccond {
 //	double operator() (double, double) {}
 };
 
+typedef mppt_temperaturehf_t<double> mppt_temperaturehf;
+
 #endif
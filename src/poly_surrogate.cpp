@@ -0,0 +1,148 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "poly_surrogate.h"
+#include <vector>
+#include <algorithm>
+
+// Samples per coefficient, along each variable.
+#define FIT_OVERSAMPLE 4
+// Points per coefficient of the error check grid.
+#define CHECK_OVERSAMPLE 16
+
+void poly_surrogate::setX(double x0, double x1) {
+	dx = -1;
+	xmin = std::min(x0, x1);
+	xmax = std::max(x0, x1);
+}
+
+void poly_surrogate::setY(double y0, double y1) {
+	dx = -1;
+	ymin = std::min(y0, y1);
+	ymax = std::max(y0, y1);
+}
+
+// Least squares solution of A x = b, by Householder QR. A is rows x cols,
+// column-major, and both A and b are overwritten. Returns false if A is rank
+// deficient.
+static bool lsq(std::vector<double> &A, int rows, int cols, std::vector<double> &b, double *x) {
+	for (int k=0; k<cols; ++k) {
+		double *a = &A[k*rows];
+		double norm = 0;
+		for (int i=k; i<rows; ++i) norm += a[i]*a[i];
+		norm = std::sqrt(norm);
+		if (norm == 0) return false;
+		double alpha = a[k] > 0 ? -norm : norm;
+		
+		// v = a(k:) - alpha e_k, stored over a(k:)
+		a[k] -= alpha;
+		double vv = 0;
+		for (int i=k; i<rows; ++i) vv += a[i]*a[i];
+		
+		for (int j=k+1; j<cols; ++j) {
+			double *aj = &A[j*rows];
+			double s = 0;
+			for (int i=k; i<rows; ++i) s += a[i]*aj[i];
+			s = 2*s/vv;
+			for (int i=k; i<rows; ++i) aj[i] -= s*a[i];
+		}
+		double s = 0;
+		for (int i=k; i<rows; ++i) s += a[i]*b[i];
+		s = 2*s/vv;
+		for (int i=k; i<rows; ++i) b[i] -= s*a[i];
+		
+		a[k] = alpha; // R diagonal
+	}
+	
+	// Back substitution on R
+	for (int k=cols-1; k>=0; --k) {
+		double s = b[k];
+		for (int j=k+1; j<cols; ++j) s -= A[j*rows + k]*x[j];
+		x[k] = s/A[k*rows + k];
+	}
+	return true;
+}
+
+// Chebyshev nodes on [-1,1], ascending.
+static void chebyshev(std::vector<double> &u, int n) {
+	u.resize(n);
+	for (int k=0; k<n; ++k) u[k] = -std::cos(M_PI*(k+0.5)/n);
+}
+
+bool poly_surrogate::fit(int degX, int degY, bool logX) {
+	dx = -1;
+	if (!f || degX < 0 || degY < 0) return false;
+	if (degX > POLY_SURROGATE_MAXDEG || degY > POLY_SURROGATE_MAXDEG) return false;
+	if (!(xmax > xmin) || !(ymax > ymin) || (logX && !(xmin > 0))) return false;
+	
+	logx = logX;
+	double a = logx ? std::log(xmin) : xmin;
+	double b = logx ? std::log(xmax) : xmax;
+	xo = (a+b)/2; xs = 2/(b-a);
+	yo = (ymin+ymax)/2; ys = 2/(ymax-ymin);
+	
+	// Samples, each row seeded from its left neighbour
+	std::vector<double> su, sv;
+	chebyshev(su, FIT_OVERSAMPLE*(degX+1));
+	chebyshev(sv, FIT_OVERSAMPLE*(degY+1));
+	int rows = su.size()*sv.size(), cols = (degX+1)*(degY+1);
+	std::vector<double> A(rows*cols), z(rows);
+	int r = 0;
+	for (size_t j=0; j<sv.size(); ++j) {
+		double y = sv[j]/ys + yo;
+		double guess = NAN;
+		for (size_t i=0; i<su.size(); ++i, ++r) {
+			double x = su[i]/xs + xo;
+			if (logx) x = std::exp(x);
+			z[r] = guess = f(x, y, guess, p);
+			if (!std::isfinite(guess)) return false;
+			
+			double ui = 1;
+			for (int ii=0; ii<=degX; ++ii, ui *= su[i]) {
+				double vj = 1;
+				for (int jj=0; jj<=degY; ++jj, vj *= sv[j]) A[(ii*(degY+1) + jj)*rows + r] = ui*vj;
+			}
+		}
+	}
+	
+	double coef[(POLY_SURROGATE_MAXDEG+1)*(POLY_SURROGATE_MAXDEG+1)];
+	if (!lsq(A, rows, cols, z, coef)) return false;
+	for (int i=0; i<=degX; ++i)
+		for (int j=0; j<=degY; ++j) c[i][j] = coef[i*(degY+1) + j];
+	dx = degX;
+	dy = degY;
+	
+	// Error, on a uniform grid
+	int nx = CHECK_OVERSAMPLE*(degX+1) + 1, ny = CHECK_OVERSAMPLE*(degY+1) + 1;
+	double esum = 0;
+	emax = 0;
+	for (int j=0; j<ny; ++j) {
+		double y = ymin + (ymax-ymin)*j/(ny-1);
+		double guess = NAN;
+		for (int i=0; i<nx; ++i) {
+			double x = xmin + (xmax-xmin)*i/(nx-1);
+			guess = f(x, y, guess, p);
+			double e = std::fabs((*this)(x,y) - guess);
+			if (!(e <= emax)) emax = e;
+			esum += e*e;
+		}
+	}
+	erms = std::sqrt(esum/(nx*ny));
+	return true;
+}
@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef POLY_SURROGATE_H
+#define POLY_SURROGATE_H
+
+#include <cmath>
+#include <cstddef>
+
+// Highest degree, per variable.
+#define POLY_SURROGATE_MAXDEG 8
+
+// Least-squares polynomial fit z(x,y), for functions smooth enough that a few
+// coefficients replace a table. Variables are scaled to [-1,1] over the fit
+// domain, and optionally x goes through a log first, for functions that bend
+// sharply as x approaches 0. Lookups outside the domain are clamped to it.
+//
+// Evaluation is a nested Horner scheme, (degX+1)*(degY+1) multiply-adds, plus
+// a log() when fitted against log(x).
+class poly_surrogate {
+	typedef double (*builder_fcn)(double X, double Y, double guess, void *p);
+	
+	double xmin, xmax, ymin, ymax;
+	double xo, xs, yo, ys; // Scaling, u = (x-xo)*xs, v = (y-yo)*ys
+	int dx, dy;
+	bool logx;
+	double c[POLY_SURROGATE_MAXDEG+1][POLY_SURROGATE_MAXDEG+1]; // c[i][j] u^i v^j
+	double emax, erms;
+	
+	builder_fcn f;
+	void *p;
+	
+	public:
+	poly_surrogate() : xmin(0), xmax(0), ymin(0), ymax(0), xo(0), xs(0), yo(0), ys(0),
+		dx(-1), dy(-1), logx(false), emax(0), erms(0), f(0), p(0) {}
+	
+	// Setup. These only discard the current fit, call fit() when done.
+	void setFunction(builder_fcn fcn, void *par) { dx = -1; f = fcn; p = par; }
+	void setX(double x0, double x1);
+	void setY(double y0, double y1);
+	
+	// Fits a polynomial of degree degX in x (or log(x)) and degY in y, on a
+	// Chebyshev grid of samples. Returns true on success.
+	bool fit(int degX, int degY, bool logX=false);
+	
+	double operator () (double x, double y) const;
+	
+	// Fit error, over a uniform grid denser than the fit samples.
+	double maxError() const { return emax; }
+	double rmsError() const { return erms; }
+	int coefficients() const { return (dx+1)*(dy+1); }
+	size_t memory() const { return (coefficients() + 4)*sizeof(double); } // Coefficients and scaling
+	
+	operator bool () const { return dx >= 0; }
+};
+
+inline double poly_surrogate::operator() (double x, double y) const {
+	if (dx < 0) return 0;
+	if (x < xmin) x = xmin;
+	if (x > xmax) x = xmax;
+	if (y < ymin) y = ymin;
+	if (y > ymax) y = ymax;
+	double u = ((logx ? std::log(x) : x) - xo)*xs;
+	double v = (y - yo)*ys;
+	
+	double z = 0;
+	for (int i=dx; i>=0; --i) {
+		double zi = 0;
+		for (int j=dy; j>=0; --j) zi = zi*v + c[i][j];
+		z = z*u + zi;
+	}
+	return z;
+}
+
+#endif
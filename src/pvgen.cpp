@@ -24,6 +24,7 @@
 
 // pvGenerator.cpp
 #include "pvgen.h"
+#include "solver_stats.h"
 
 // Static constants
 const double pvGenerator::q = 1.602177e-19;
@@ -78,12 +79,16 @@ double pvGenerator::V(
 	const model_parameters_t &m,
 	double I, double vn
 ) const {
+	SOLVER_CALL(SOLVER_PVGEN_V);
 #if defined V_FROM_I_NEWTON
 	double vo=-100;
 	int itr=itrLimit;
 	while (itr--) {
 		vn -= f(m,vn,I)/dfdv(m,vn,I);
-		if (fabs(vn-vo)<fabs(eMax*vo)) return vn;
+		if (fabs(vn-vo)<fabs(eMax*vo)) {
+			SOLVER_DONE(itrLimit-itr, true);
+			return vn;
+		}
 		vo=vn;
 	}
 #else
@@ -94,11 +99,15 @@ double pvGenerator::V(
 	double Y0 = f(m,V0,I);
 	while (itr--) {
 		double V2 = V1 - Y1 * (V1-V0) / (Y1-Y0);
-		if (fabs(V2-V1)<fabs(eMax*V1)) return V2;
+		if (fabs(V2-V1)<fabs(eMax*V1)) {
+			SOLVER_DONE(itrLimit-itr, true);
+			return V2;
+		}
 		V0=V1; Y0=Y1;
 		V1=V2; Y1=f(m,V1,I);
 	}
 #endif
+	SOLVER_DONE(itrLimit, false);
 	return NAN;
 }
 
@@ -106,13 +115,18 @@ double pvGenerator::I(
 	const model_parameters_t &m,
 	double V, double in
 ) const {
+	SOLVER_CALL(SOLVER_PVGEN_I);
 	double io=-100;
 	int itr=itrLimit;
 	while (itr--) {
 		in -= f(m,V,in)/dfdi(m,V,in);
-		if (fabs(in-io)<fabs(eMax*io)) return in;
+		if (fabs(in-io)<fabs(eMax*io)) {
+			SOLVER_DONE(itrLimit-itr, true);
+			return in;
+		}
 		io=in;
 	}
+	SOLVER_DONE(itrLimit, false);
 	return NAN;
 }
 
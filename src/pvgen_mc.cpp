@@ -25,6 +25,8 @@
 // pvGenerator.cpp
 #include "pvgen_mc.h"
 #include "error.h"
+#include "solver_stats.h"
+#include <algorithm>
 
 // #define DEBUG
 #include "debug.h"
@@ -120,9 +122,44 @@ void pvGenerator_mc::setTemperature(int i, double nt) {
 
 // Solvers
 
+void pvGenerator_mc::setBypass(int n, double Vd) {
+	bypass  = n > 0 ? n : 0;
+	Vbypass = Vd;
+}
+
+// Cells under the same insolation and temperature share a solution, and
+// under partial shading most do, so each is reused until one differs.
+double pvGenerator_mc::cellV(int i, double I, double vn, int &last, double &vlast) const {
+	if (last < 0 || cell[i].G != cell[last].G || cell[i].T != cell[last].T) {
+		vlast = pvGenerator::V(cell[i], I, vn);
+		last = i;
+	}
+	return vlast;
+}
+
 double pvGenerator_mc::V(double I, double vn) const { // Resolve V de I
-	double v = 0;
-	for (int i=0; i<cell.size(); ++i) v += pvGenerator::V(cell[i], I, vn/cell.size());
+	double v = 0, vc = 0;
+	int last = -1;
+	int ncells = cell.size();
+	if (!bypass) {
+		for (int i=0; i<ncells; ++i) v += cellV(i, I, vn/ncells, last, vc);
+		return v;
+	}
+	
+	for (int g=0; g<ncells; g+=bypass) {
+		int n = std::min(bypass, ncells-g);
+		
+		// No cell is forward biased above 1V, so a cell whose voltage is
+		// below -(Vbypass + n) turns the diode on whatever the others do.
+		// Checked first, as a cell driven far beyond its photocurrent takes
+		// the longest to solve, or has no solution at all.
+		double vg = 0;
+		for (int i=g; i<g+n && !std::isnan(vg); ++i) {
+			if (f(cell[i], -(Vbypass+n), I) < 0) vg = NAN;
+			else vg += cellV(i, I, vn/ncells, last, vc);
+		}
+		v += (std::isnan(vg) || vg < -Vbypass) ? -Vbypass : vg;
+	}
 	return v;
 }
 
@@ -172,6 +209,7 @@ double pvGenerator_mc::I(double tV, double nI) const { // Resolve I de V
 #if 1
 // Solve by my descending step method
 double pvGenerator_mc::I(double tV, double in) const { // Resolve I de V
+	SOLVER_CALL(SOLVER_PVGEN_MC_I);
 	double nI=0, dI=1;
 	int n=itrLimit;
 	
@@ -187,11 +225,15 @@ double pvGenerator_mc::I(double tV, double in) const { // Resolve I de V
 			else        nI += dI/10;
 			nV = V(nI);
 		}
-		if (nV==tV || fabs(dI)<eMax) return nI;
+		if (nV==tV || fabs(dI)<eMax) {
+			SOLVER_DONE(itrLimit-n, nV==tV || fabs(nV-tV) <= eMax*fabs(tV));
+			return nI;
+		}
 		if (nV>tV) nI += dI;
 		else       nI -= dI;
 		dI *= 0.55;
 	}
+	SOLVER_DONE(itrLimit, false);
 	throw mk_error("Iteration limits exceeded.");
 }
 #endif
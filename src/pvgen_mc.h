@@ -30,11 +30,14 @@
 
 class pvGenerator_mc : public pvGenerator {
 	std::vector<model_parameters_t> cell;
+	int bypass;     // Cells per bypass diode, 0 for none
+	double Vbypass; // Bypass diode forward drop
 	
 	void updateCells();
+	double cellV(int i, double I, double vn, int &last, double &vlast) const;
 	
 	public:
-	pvGenerator_mc() {
+	pvGenerator_mc() : bypass(0), Vbypass(0) {
 		// Do nothing
 	}
 	void setNs(int Ns);
@@ -54,6 +57,13 @@ class pvGenerator_mc : public pvGenerator {
 	void setRp(double Rp);
 	void setModel(const model_parameters_t &m);
 	
+	// Bypass diodes, one across every n cells (the last group may be
+	// shorter), modelled as ideal with a forward drop of Vd. A group that
+	// can not carry the string current, as when a cell is shaded, is clamped
+	// to -Vd. Use 0 cells for none, the default.
+	void setBypass(int n, double Vd=0.4);
+	int getBypass() const { return bypass; }
+	
 	double getInsolation(int i) const {
 		if (i<0 || i>=cell.size()) return NAN;
 		return cell[i].G;
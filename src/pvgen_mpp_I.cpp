@@ -18,6 +18,7 @@
  ***************************************************************************/
 
 #include "pvgen_mpp_I.h"
+#include "solver_stats.h"
 
 //#define DEBUG
 #include "debug.h"
@@ -28,6 +29,8 @@
 //   Convergence takes ceil(log((Ih-Il)/eMax)/log(2)) iterations.
 //   Default values lead to 13 iterations.
 double pvgen_mpp_I(pvGenerator &r, double Il, double Ih, double eMax) {
+	SOLVER_CALL(SOLVER_MPP_I);
+	int n = 0;
 	double I[5] = {
 		Il,
 		0,
@@ -49,6 +52,7 @@ double pvgen_mpp_I(pvGenerator &r, double Il, double Ih, double eMax) {
 	debug_say(I[4]<<" "<<P[4]);
 	
 	while (fabs(I[0]-I[4]) > eMax) {
+		++n;
 		I[1] = (I[0]+I[2])/2;
 		P[1] = r.V(I[1])*I[1];
 		I[3] = (I[2]+I[4])/2;
@@ -70,6 +74,7 @@ double pvgen_mpp_I(pvGenerator &r, double Il, double Ih, double eMax) {
 	}
 	
 	debug_say("pvgen_mpp_I end: I="<<I[2]);
+	SOLVER_DONE(n, !std::isnan(P[2]));
 	return I[2];
 }
 
@@ -121,3 +126,23 @@ double pvgen_mpp_I(pvGenerator &r, double Il, double Ih, double eMax) {
 }
 
 #endif
+
+double pvgen_gmpp_I(pvGenerator &r, double Il, double Ih, double eMax, int n) {
+	int kbest = 0;
+	double Pbest = -HUGE_VAL;
+	for (int k=0; k<=n; ++k) {
+		double I = Il + (Ih-Il)*k/n;
+		double P = r.V(I)*I;
+		if (P > Pbest) {
+			Pbest = P;
+			kbest = k;
+		}
+	}
+	
+	double dI = (Ih-Il)/n;
+	double I0 = Il + dI*(kbest-1);
+	double I1 = Il + dI*(kbest+1);
+	if (I0 < Il) I0 = Il;
+	if (I1 > Ih) I1 = Ih;
+	return pvgen_mpp_I(r, I0, I1, eMax);
+}
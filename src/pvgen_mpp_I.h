@@ -27,4 +27,9 @@
 //   Default values lead to 13 iterations.
 extern double pvgen_mpp_I(pvGenerator &r, double Il, double Ih, double eMax);
 
+// Global MPP of r, for curves with several peaks, as with bypass diodes
+// under partial shading. Samples P at n+1 currents, then refines the best
+// with pvgen_mpp_I. Peaks narrower than (Ih-Il)/n may be missed.
+extern double pvgen_gmpp_I(pvGenerator &r, double Il, double Ih, double eMax, int n=64);
+
 #endif
\ No newline at end of file
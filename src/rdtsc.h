@@ -1,41 +1,67 @@
-/***************************************************************************
- *   Copyright (C) 2007 by Lucas V. Hartmann <lucas.hartmann@gmail.com>.   *
- *                                                                         *
- *   This program is free software; you can redistribute it and/or modify  *
- *   it under the terms of the GNU General Public License as published by  *
- *   the Free Software Foundation; either version 2 of the License, or     *
- *   (at your option) any later version.                                   *
- *                                                                         *
- *   This program is distributed in the hope that it will be useful,       *
- *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
- *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
- *   GNU General Public License for more details.                          *
- *                                                                         *
- *   You should have received a copy of the GNU General Public License     *
- *   along with this program; if not, write to the                         *
- *   Free Software Foundation, Inc.,                                       *
- *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
- ***************************************************************************/
-
-#ifndef RDTSC_H
-#define RDTSC_H
-
-typedef unsigned long long timestamp;
-
-static inline volatile timestamp read_timestamp_counter() {
-	union {
-		timestamp ull;
-		unsigned long ul[2];
-	};
-	asm(
-		"rdtsc"
-		: "=d" (ul[1]), "=a" (ul[0])
-	);
-	return ull;
-}
-
-//#define CPU_CLOCK (11.5*150e6/9.) // 1.91 GHz (AMD Mobile Athlon XP 2500+)
-#define CPU_CLOCK (2.667e9) // 2.66 GHz (Intel Pentium D)
-#define timestamp_to_seconds(v) ((v)/CPU_CLOCK)
-
-#endif
+/***************************************************************************
+ *   Copyright (C) 2007 by Lucas V. Hartmann <lucas.hartmann@gmail.com>.   *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef RDTSC_H
+#define RDTSC_H
+
+#include <time.h>
+
+typedef unsigned long long timestamp;
+
+#if defined(__i386__) || defined(__x86_64__)
+static inline timestamp read_timestamp_counter() {
+	unsigned int lo, hi; // unsigned long is 64 bits on x86_64
+	asm volatile(
+		"rdtsc"
+		: "=d" (hi), "=a" (lo)
+	);
+	return (timestamp(hi) << 32) | lo;
+}
+#else
+// No TSC, count nanoseconds instead.
+static inline timestamp read_timestamp_counter() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timestamp(ts.tv_sec)*1000000000ull + ts.tv_nsec;
+}
+#endif
+
+// Counter ticks per second, measured against CLOCK_MONOTONIC on first use,
+// which sleeps for 20ms. The TSC of current CPUs ticks at a fixed rate,
+// whatever the core clock.
+static inline double calibrate_timestamp_counter() {
+	struct timespec t0, t1, d = {0, 20000000};
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	timestamp c0 = read_timestamp_counter();
+	nanosleep(&d, 0);
+	timestamp c1 = read_timestamp_counter();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (c1-c0) / ((t1.tv_sec-t0.tv_sec) + 1e-9*(t1.tv_nsec-t0.tv_nsec));
+}
+static inline double cpu_clock() {
+	static const double hz = calibrate_timestamp_counter();
+	return hz;
+}
+
+//#define CPU_CLOCK (11.5*150e6/9.) // 1.91 GHz (AMD Mobile Athlon XP 2500+)
+//#define CPU_CLOCK (2.667e9) // 2.66 GHz (Intel Pentium D)
+#define CPU_CLOCK (cpu_clock())
+#define timestamp_to_seconds(v) ((v)/CPU_CLOCK)
+
+#endif
@@ -0,0 +1,155 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "rt_loop.h"
+#include <cstring>
+#include <cerrno>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+static int64_t monotonic_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return int64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+// Sleeps until t, in CLOCK_MONOTONIC ns, or until quit.
+static void sleep_until(int64_t t, const std::atomic<bool> &quit) {
+	struct timespec ts;
+	ts.tv_sec  = t / 1000000000;
+	ts.tv_nsec = t % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR && !quit);
+}
+
+rt_loop::rt_loop() : period(1), delay(0), priority(0), cpu(-1), overrun(RT_OVERRUN_ABORT),
+	tick(0), arg(0), started(false), quit(false), finished(false), abort(false),
+	nticks(0), noverruns(0), nskipped(0), late(0)
+{
+	// Do nothing
+}
+
+rt_loop::~rt_loop() {
+	stop();
+}
+
+bool rt_loop::start(tick_fn f, void *a) {
+	if (started || !f || !(period > 0)) {
+		errno = EINVAL;
+		return false;
+	}
+	tick = f;
+	arg  = a;
+	quit = finished = abort = false;
+	
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	int e = 0;
+	if (priority > 0) {
+		struct sched_param sp;
+		memset(&sp, 0, sizeof(sp));
+		sp.sched_priority = priority;
+		e = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		if (!e) e = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		if (!e) e = pthread_attr_setschedparam(&attr, &sp);
+	}
+	if (!e && cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		e = pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	}
+	
+	// The thread inherits the signal mask
+	sigset_t block, old;
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	sigaddset(&block, SIGALRM);
+	sigaddset(&block, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &block, &old);
+	if (!e) e = pthread_create(&tid, &attr, worker, this);
+	pthread_sigmask(SIG_SETMASK, &old, 0);
+	pthread_attr_destroy(&attr);
+	
+	if (e) {
+		errno = e;
+		return false;
+	}
+	started = true;
+	return true;
+}
+
+void rt_loop::stop() {
+	if (!started) return;
+	quit = true;
+	pthread_join(tid, 0);
+	started = false;
+}
+
+void *rt_loop::worker(void *self) {
+	((rt_loop*)self)->run();
+	return 0;
+}
+
+void rt_loop::run() {
+	int64_t step = int64_t(period*1e9 + 0.5);
+	int64_t next = monotonic_ns() + int64_t(delay*1e9);
+	while (!quit) {
+		sleep_until(next, quit);
+		if (quit) break;
+		
+		int64_t now = monotonic_ns();
+		if (now - next > late) late = now - next;
+		bool go = tick(arg);
+		++nticks;
+		if (!go) break;
+		
+		next += step;
+		now = monotonic_ns();
+		if (now <= next) continue;
+		
+		// Overrun, the next deadline is gone
+		++noverruns;
+		if (overrun == RT_OVERRUN_ABORT) {
+			abort = true;
+			break;
+		}
+		if (overrun == RT_OVERRUN_SKIP) {
+			int64_t missed = (now - next)/step + 1;
+			next += missed*step;
+			nskipped += missed;
+		}
+	}
+	finished = true;
+}
+
+bool rt_lock_memory() {
+	return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+bool rt_overrun_policy_by_name(const char *name, rt_overrun_policy &p) {
+	if      (!strcmp(name, "abort"))   p = RT_OVERRUN_ABORT;
+	else if (!strcmp(name, "skip"))    p = RT_OVERRUN_SKIP;
+	else if (!strcmp(name, "catchup")) p = RT_OVERRUN_CATCHUP;
+	else return false;
+	return true;
+}
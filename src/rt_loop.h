@@ -0,0 +1,99 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef RT_LOOP_H
+#define RT_LOOP_H
+
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+
+// What to do when a tick runs past the next deadline.
+enum rt_overrun_policy {
+	RT_OVERRUN_ABORT,   // Stop the loop
+	RT_OVERRUN_SKIP,    // Drop the ticks missed, carry on at the next deadline ahead
+	RT_OVERRUN_CATCHUP  // Run the ticks missed back to back, then carry on
+};
+
+// Periodic control loop on a thread of its own. Ticks are due at absolute
+// CLOCK_MONOTONIC deadlines, start + delay + k*period, and slept for with
+// clock_nanosleep(TIMER_ABSTIME), so the time one tick takes never shifts
+// the ones after it. Ticks run in thread context, not in a signal handler,
+// so they may do I/O and lock like any other code. SIGINT, SIGTERM,
+// SIGALRM and SIGUSR1 are blocked in the loop thread, and left to the main
+// one.
+//
+// The thread may run under SCHED_FIFO and be pinned to one CPU, which
+// usually needs root or CAP_SYS_NICE. Lock memory with rt_lock_memory()
+// beforehand, so page faults do not stall ticks.
+class rt_loop {
+	public:
+	typedef bool (*tick_fn)(void *arg); // Returns false to stop the loop
+	
+	double period;   // Between ticks, s
+	double delay;    // Before the first tick, s
+	int    priority; // SCHED_FIFO priority, 0 for the default scheduler
+	int    cpu;      // CPU to run on, -1 for any
+	rt_overrun_policy overrun;
+	
+	rt_loop();
+	~rt_loop();
+	
+	// Starts the loop thread. Returns false, with errno set, if it could
+	// not be created with the scheduling requested.
+	bool start(tick_fn tick, void *arg);
+	
+	// Stops the loop, after the tick running, if any.
+	void stop();
+	
+	bool running() const { return started && !finished; }
+	bool aborted() const { return abort; } // Stopped by an overrun
+	
+	// Statistics, may be read while running
+	long ticks() const { return nticks; }
+	long overruns() const { return noverruns; } // Ticks that ran past the next deadline
+	long skipped() const { return nskipped; }   // Ticks dropped by RT_OVERRUN_SKIP
+	double maxLate() const { return 1e-9*late; } // Worst tick start past its deadline, s
+	
+	private:
+	tick_fn tick;
+	void *arg;
+	pthread_t tid;
+	bool started;
+	std::atomic<bool> quit, finished, abort;
+	std::atomic<long> nticks, noverruns, nskipped;
+	std::atomic<int64_t> late;
+	
+	static void *worker(void *self);
+	void run();
+	
+	// Non-copyable
+	rt_loop(const rt_loop &);
+	rt_loop &operator=(const rt_loop &);
+};
+
+// Locks current and future memory of the process, mlockall(). Returns
+// false, with errno set, on failure.
+extern bool rt_lock_memory();
+
+// Overrun policy from its name: skip, catchup or abort.
+extern bool rt_overrun_policy_by_name(const char *name, rt_overrun_policy &p);
+
+#endif
@@ -0,0 +1,159 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "sample_logger.h"
+#include <charconv>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+// Longest line: every value at 22 characters, plus separators
+#define SAMPLE_LINE_MAX (SAMPLE_FIELDS*23 + 1)
+
+// The ring is drained this often, ms, whatever the flush interval
+#define SAMPLE_DRAIN_MS 50
+
+static int64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return int64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+sample_logger::sample_logger() : nrecords(0), ndropped(0), fd(-1), opened(false), failed(false),
+	used(0), nwrites(0), maxWrite_(0), flushInterval(1000) {
+	wake[0] = wake[1] = -1;
+}
+
+bool sample_logger::open(const char *filename, const char *header) {
+	close();
+	fd = ::open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd < 0) return false;
+	
+	size_t n = strlen(header);
+	if (n + 1 > sizeof(block)) n = sizeof(block) - 1;
+	memcpy(block, header, n);
+	block[n] = '\n';
+	used = n + 1;
+	nrecords = ndropped = 0;
+	nwrites = 0;
+	maxWrite_ = 0;
+	failed = false;
+	
+	if (pipe(wake)) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	sigset_t mask, old;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old); // Signals are for the main thread
+	int e = pthread_create(&tid, 0, worker, this);
+	pthread_sigmask(SIG_SETMASK, &old, 0);
+	if (e) {
+		::close(wake[0]);
+		::close(wake[1]);
+		wake[0] = wake[1] = -1;
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	opened = true;
+	return true;
+}
+
+void sample_logger::close() {
+	if (!opened) return;
+	char c = 0;
+	if (write(wake[1], &c, 1)) {}
+	pthread_join(tid, 0);
+	::close(wake[0]);
+	::close(wake[1]);
+	wake[0] = wake[1] = -1;
+	
+	// Anything pushed while the thread was stopping
+	drain();
+	flush();
+	::close(fd);
+	fd = -1;
+	opened = false;
+}
+
+// Formats every record in the ring into the block, writing it out whenever
+// it fills.
+void sample_logger::drain() {
+	sample_record r;
+	while (ring.pop(r)) {
+		if (sizeof(block) - used < SAMPLE_LINE_MAX) flush();
+		char *p = block + used, *end = block + sizeof(block);
+		int n = r.n < 0 ? 0 : r.n > SAMPLE_FIELDS ? SAMPLE_FIELDS : r.n;
+		for (int i=0; i<n; ++i) {
+			if (i) *p++ = ' ';
+			p = std::to_chars(p, end, r.v[i], std::chars_format::general, 15).ptr;
+		}
+		*p++ = '\n';
+		used = p - block;
+		++nrecords;
+	}
+}
+
+// Writes the block out. On errors the block is dropped, so the ring keeps
+// draining.
+void sample_logger::flush() {
+	if (!used) return;
+	int64_t t0 = now_ns();
+	size_t done = 0;
+	while (done < used) {
+		ssize_t n = write(fd, block + done, used - done);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) {
+			failed = true;
+			break;
+		}
+		done += n;
+	}
+	int64_t dt = now_ns() - t0;
+	if (dt > maxWrite_) maxWrite_ = dt;
+	++nwrites;
+	used = 0;
+}
+
+void *sample_logger::worker(void *self) {
+	sample_logger &l = *(sample_logger*)self;
+	int64_t last = now_ns();
+	for (;;) {
+		int ms = l.flushInterval > 0 && l.flushInterval < SAMPLE_DRAIN_MS ? l.flushInterval : SAMPLE_DRAIN_MS;
+		struct pollfd p;
+		p.fd = l.wake[0];
+		p.events = POLLIN;
+		if (poll(&p, 1, ms) > 0) break;
+		
+		l.drain();
+		int64_t t = now_ns();
+		if (t - last >= int64_t(l.flushInterval)*1000000) {
+			l.flush();
+			last = t;
+		}
+	}
+	return 0;
+}
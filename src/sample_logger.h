@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef SAMPLE_LOGGER_H
+#define SAMPLE_LOGGER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <pthread.h>
+#include "spsc_ring.h"
+
+// Most values in a logged sample
+#define SAMPLE_FIELDS 12
+
+// One line of the data file
+struct sample_record {
+	int n;                     // Values used
+	double v[SAMPLE_FIELDS];
+};
+
+// Data file of the hardware loop. The control thread push()es fixed size
+// records into a lock-free ring, never blocking nor allocating, and a thread
+// of its own formats them as text, %.15g separated by spaces, into a 64KiB
+// block, written when full or every flushInterval ms. A slow disk only
+// backs up the ring; records that find it full are dropped, and counted.
+class sample_logger {
+	spsc_ring<sample_record, 8192> ring;
+	std::atomic<long> nrecords, ndropped;
+	
+	// Writer thread
+	int fd;
+	bool opened, failed;
+	pthread_t tid;
+	int wake[2];               // Pipe, written to stop the thread
+	char block[65536];
+	size_t used;
+	long nwrites;
+	int64_t maxWrite_;
+	
+	static void *worker(void *self);
+	void drain();
+	void flush();
+	
+	// Non-copyable
+	sample_logger(const sample_logger &);
+	sample_logger &operator=(const sample_logger &);
+	
+	public:
+	int flushInterval; // Longest a record waits in the block, ms
+	
+	sample_logger();
+	~sample_logger() { close(); }
+	
+	// Creates (truncates) filename, writes the header line and starts the
+	// writer thread.
+	bool open(const char *filename, const char *header);
+	void close(); // Writes out everything pushed so far
+	operator bool () const { return opened; }
+	
+	// Control thread
+	bool push(const sample_record &r) {
+		if (ring.push(r)) return true;
+		++ndropped;
+		return false;
+	}
+	
+	long records() const { return nrecords; } // Written out
+	long dropped() const { return ndropped; }
+	long writes() const { return nwrites; }   // write() calls, valid after close()
+	double maxWrite() const { return 1e-9*maxWrite_; } // Longest write(), s
+	bool error() const { return failed; }     // A write failed, records lost
+};
+
+#endif
@@ -0,0 +1,266 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/***************************************************************************
+ *   Sensor box stand-in: serves "G T1 T2 0 0" lines over TCP, as the      *
+ *   insolation and temperature sensors do for denis_sensors, from fixed   *
+ *   values or a stimuli file, so that mppt -sa can run without the box.   *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "arg_tool.h"
+#include "straux.h"
+#include "load_dat.h"
+
+using namespace std;
+
+int iHelp, iPort, iBind, iStimuli, iSpeed, iG, iT1, iT2, iPeriod, iOnce, iUtf16;
+arg_t args[] = {
+	{"-h",        &iHelp,    ARG_FLAG},
+	{"--help",    &iHelp,    ARG_FLAG},
+	{"--port",    &iPort,    ARG_DEFAULT},
+	{"--bind",    &iBind,    ARG_DEFAULT},
+	{"--stimuli", &iStimuli, ARG_DEFAULT},
+	{"--speed",   &iSpeed,   ARG_DEFAULT},
+	{"-G",        &iG,       ARG_DEFAULT},
+	{"-T1",       &iT1,      ARG_DEFAULT},
+	{"-T2",       &iT2,      ARG_DEFAULT},
+	{"--period",  &iPeriod,  ARG_DEFAULT},
+	{"--once",    &iOnce,    ARG_FLAG},
+	{"--utf16",   &iUtf16,   ARG_FLAG},
+	{0,0,0}
+};
+
+static volatile sig_atomic_t quit = 0;
+static void quit_handler(int) { quit = 1; }
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static vector<double> Time, G, T1, T2;
+static double G0 = 1000, T10 = 40, T20 = 40;
+static double speed = 1;
+static double start = NAN; // First connection
+
+// The reading at the current time, stimuli interpolated, the last sample
+// held past the end.
+static string reading() {
+	double g = G0, t1 = T10, t2 = T20;
+	if (!Time.empty()) {
+		static size_t k = 0;
+		double ts = Time[0] + speed*(now() - start);
+		while (k+1 < Time.size() && Time[k+1] <= ts) ++k;
+		double a = 0;
+		size_t j = k;
+		if (k+1 < Time.size() && ts > Time[k]) {
+			a = (ts - Time[k]) / (Time[k+1] - Time[k]);
+			j = k+1;
+		}
+		g  = G [k] + a*(G [j] - G [k]);
+		t1 = T1[k] + a*(T1[j] - T1[k]);
+		t2 = T2[k] + a*(T2[j] - T2[k]);
+	}
+	char s[128];
+	snprintf(s, sizeof(s), "%.1f %.2f %.2f 0 0\n", g, t1, t2);
+	if (!iUtf16) return s;
+	
+	// As the box might send it, UTF16 big endian
+	string u;
+	for (char *c=s; *c; ++c) {
+		u += '\0';
+		u += *c;
+	}
+	return u;
+}
+
+static bool send_all(int s, const string &d) {
+	return send(s, d.data(), d.length(), MSG_NOSIGNAL) == int(d.length());
+}
+
+int main(int argc, const char *argv[]) {
+	if (arg_eval(argc, argv, args)) {
+		cerr<<"Error: Command line parsing failed."<<endl;
+		return 1;
+	}
+	if (iHelp) {
+		cout<<"Usage: sensorsim [--port N] [--bind ADDR] [--stimuli FILE] [--speed X]"<<endl;
+		cout<<"                 [-G W/m2] [-T1 C] [-T2 C] [--period MS] [--once] [--utf16]"<<endl;
+		cout<<"Serves insolation and temperature readings on TCP port N (1800) of ADDR"<<endl;
+		cout<<"(127.0.0.1), a line every MS ms (200) to each client, or one line per"<<endl;
+		cout<<"connection with --once. Readings follow the stimuli (G, and T, or T1"<<endl;
+		cout<<"and T2) from the first connection on, X times as fast, or are fixed at G"<<endl;
+		cout<<"(1000), T1 and T2 (40)."<<endl;
+		return 0;
+	}
+	
+	int port = 1800;
+	if (iPort) port = strIsInt(argv[iPort]) ? atoi(argv[iPort]) : 0;
+	if (port <= 0 || port > 65535) {
+		cerr<<"Error: --port requires a TCP port number."<<endl;
+		return 1;
+	}
+	int period = 200;
+	if (iPeriod) period = strIsInt(argv[iPeriod]) ? atoi(argv[iPeriod]) : 0;
+	if (period <= 0) {
+		cerr<<"Error: --period requires a positive number of ms."<<endl;
+		return 1;
+	}
+	if (iSpeed) speed = strIsFloat(argv[iSpeed]) ? atof(argv[iSpeed]) : -1;
+	if (speed <= 0) {
+		cerr<<"Error: --speed requires a positive number."<<endl;
+		return 1;
+	}
+	if (iG)  G0  = strIsFloat(argv[iG])  ? atof(argv[iG])  : NAN;
+	if (iT1) T10 = strIsFloat(argv[iT1]) ? atof(argv[iT1]) : NAN;
+	if (iT2) T20 = strIsFloat(argv[iT2]) ? atof(argv[iT2]) : NAN;
+	if (isnan(G0) || isnan(T10) || isnan(T20)) {
+		cerr<<"Error: -G, -T1 and -T2 require a number."<<endl;
+		return 1;
+	}
+	
+	if (iStimuli) {
+		std::map<std::string, std::vector<double> > stimuli = load_dat(argv[iStimuli]);
+		Time = stimuli["Time"];
+		G    = stimuli["G"];
+		T1   = stimuli["T1"];
+		T2   = stimuli["T2"];
+		if (T1.empty()) T1 = stimuli["T"];
+		if (T2.empty()) T2 = T1;
+		if (Time.empty() || G.size() < Time.size() || T1.size() < Time.size() || T2.size() < Time.size()) {
+			cerr<<"Error: Stimuli file does not contain required variables Time, G and T (or T1 and T2)."<<endl;
+			return 1;
+		}
+		// Celsius, as the box sends them
+		for (size_t i=0; i<Time.size(); ++i) {
+			if (T1[i] > 200) T1[i] -= 273.16;
+			if (T2[i] > 200) T2[i] -= 273.16;
+		}
+	}
+	
+	// Listen
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (!inet_aton(iBind ? argv[iBind] : "127.0.0.1", &addr.sin_addr)) {
+		cerr<<"Error: --bind requires an IPv4 address."<<endl;
+		return 1;
+	}
+	int ls = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (ls < 0 || bind(ls, (sockaddr*)&addr, sizeof(addr)) || listen(ls, 8)) {
+		cerr<<"Error: Failed to listen on port "<<port<<": "<<strerror(errno)<<"."<<endl;
+		return 1;
+	}
+	
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = quit_handler;
+	sigaction(SIGINT,  &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+	
+	cout<<"<< Sensor box stand-in >>"<<endl;
+	cout<<"Listening on "<<inet_ntoa(addr.sin_addr)<<":"<<port<<"."<<endl;
+	
+	vector<int> clients;
+	long connections = 0, lines = 0;
+	double next = now();
+	while (!quit) {
+		vector<struct pollfd> p(1);
+		p[0].fd = ls;
+		p[0].events = POLLIN;
+		for (size_t i=0; i<clients.size(); ++i) {
+			struct pollfd c;
+			c.fd = clients[i];
+			c.events = POLLIN; // Hang ups
+			p.push_back(c);
+		}
+		int wait = clients.empty() ? -1 : max(0, int(1e3*(next - now())));
+		if (poll(&p[0], p.size(), wait) < 0) continue;
+		
+		// Clients gone, anything they send is dropped
+		for (size_t i=p.size()-1; i>0; --i) {
+			if (!p[i].revents) continue;
+			char buf[256];
+			if (recv(p[i].fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) continue;
+			close(p[i].fd);
+			clients.erase(clients.begin() + (i-1));
+		}
+		
+		if (p[0].revents & POLLIN) {
+			int c = accept(ls, 0, 0);
+			if (c >= 0) {
+				++connections;
+				if (isnan(start)) start = now();
+				bool ok = send_all(c, reading());
+				lines += ok;
+				if (iOnce || !ok) {
+					close(c);
+				} else {
+					if (clients.empty()) next = now() + 1e-3*period;
+					clients.push_back(c);
+				}
+			}
+		}
+		
+		if (!clients.empty() && now() >= next) {
+			string r = reading();
+			for (size_t i=clients.size(); i-- > 0; ) {
+				if (send_all(clients[i], r)) {
+					++lines;
+				} else {
+					close(clients[i]);
+					clients.erase(clients.begin() + i);
+				}
+			}
+			next += 1e-3*period;
+			if (next < now()) next = now() + 1e-3*period;
+		}
+	}
+	
+	for (size_t i=0; i<clients.size(); ++i) close(clients[i]);
+	close(ls);
+	cout<<connections<<" connections, "<<lines<<" lines served."<<endl;
+	return 0;
+}
@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+#include <type_traits>
+
+// Latest value of a T, written by one thread and read by any. Neither side
+// blocks nor allocates: load() copies the value, and retries if a store()
+// overlapped it. The value is kept as atomic words, so a torn copy is never
+// undefined, only discarded.
+template <typename T>
+class seqlock {
+	static_assert(std::is_trivially_copyable<T>::value, "seqlock needs a trivially copyable type");
+	enum { WORDS = (sizeof(T) + 7) / 8 };
+	
+	std::atomic<uint32_t> seq; // Odd while a store is under way
+	std::atomic<uint64_t> word[WORDS];
+	
+	public:
+	seqlock() : seq(0) {
+		for (int i=0; i<WORDS; ++i) word[i].store(0, std::memory_order_relaxed);
+	}
+	
+	// Writer
+	void store(const T &x) {
+		uint64_t w[WORDS] = {0};
+		std::memcpy(w, &x, sizeof(T));
+		uint32_t s = seq.load(std::memory_order_relaxed);
+		seq.store(s+1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (int i=0; i<WORDS; ++i) word[i].store(w[i], std::memory_order_relaxed);
+		seq.store(s+2, std::memory_order_release);
+	}
+	
+	// Readers. Returns how many stores there have been, 0 for none, in
+	// which case x is all zeros.
+	uint32_t load(T &x) const {
+		uint64_t w[WORDS];
+		uint32_t s0, s1;
+		do {
+			s0 = seq.load(std::memory_order_acquire);
+			for (int i=0; i<WORDS; ++i) w[i] = word[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			s1 = seq.load(std::memory_order_relaxed);
+		} while ((s0 & 1) || s0 != s1);
+		std::memcpy(&x, w, sizeof(T));
+		return s0 / 2;
+	}
+};
+
+#endif
@@ -18,6 +18,9 @@
  ***************************************************************************/
 
 #include "serial.h"
+#include <cstring>
+#include <poll.h>
+#include <time.h>
 
 //#define DUMP_BYTEINS
 #ifdef DUMP_BYTEINS
@@ -36,6 +39,9 @@ serialHandler::serialHandler() {
 	portToRt=1000;
 	portToWm=10;
 	portToWt=1000;
+	epollHandle=INVALID_HANDLE_VALUE;
+	rpos=rlen=0;
+	tap=0;
 }
 
 bool serialHandler::Connect() {
@@ -44,10 +50,19 @@ bool serialHandler::Connect() {
 		portName="/dev/ttyS";
 		portName+=char('0'+port);
 	}
-	portHandle = ::open (portName.c_str(), O_RDWR | O_NOCTTY | O_SYNC);
+	portHandle = ::open (portName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
 // 	portHandle = ::open ("/dev/ttyUSB0", O_RDWR | O_NOCTTY | O_SYNC);
 	if (Connected()) {
-		fcntl(portHandle,F_SETFL,0);
+		fcntl(portHandle,F_SETFL,O_NONBLOCK);
+		epollHandle = epoll_create1(0);
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.fd = portHandle;
+		if (epollHandle<0 || epoll_ctl(epollHandle, EPOLL_CTL_ADD, portHandle, &ev)) {
+			Disconnect();
+			return true;
+		}
+		rpos = rlen = 0;
 		setBaudRate(getBaudRate());
 		setParity(portParity);
 		setReadTimeouts(portToRs,portToRm,portToRt);
@@ -61,6 +76,8 @@ bool serialHandler::Connect() {
 		options.c_oflag &= ~(OPOST);
 		options.c_lflag |= NOFLSH;
 		options.c_lflag &= ~(ICANON|ECHO|ECHOE|ISIG);
+		options.c_cc[VMIN] = 1;
+		options.c_cc[VTIME] = 0;
 		tcsetattr(portHandle, TCSANOW, &options);
 		return false;
 	}
@@ -68,10 +85,15 @@ bool serialHandler::Connect() {
 }
 
 void serialHandler::Disconnect() {
+	if (epollHandle!=INVALID_HANDLE_VALUE) {
+		close(epollHandle);
+		epollHandle=INVALID_HANDLE_VALUE;
+	}
 	if (Connected()) {
 		close(portHandle);
 		portHandle=INVALID_HANDLE_VALUE;
 	}
+	rpos=rlen=0;
 }
 
 bool serialHandler::setPort(int p) {
@@ -223,38 +245,101 @@ void serialHandler::setParity(enum parity p) {
 }
 
 // Funções de Entrada e Saída
-inline int foolwrite(int &fd, const char *data, size_t nbytes) {
-	return write(fd,data,nbytes);
+static long long now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000LL + ts.tv_nsec/1000000;
 }
 
+// Writes all n bytes, waiting for room when the output queue is full, for
+// portToWt + portToWm ms per byte at most.
 bool serialHandler::write(const char *p, int n) {
 	if (!Connected()) return true;
-	return foolwrite(portHandle,p,n) < 0;
+	long long deadline = now_ms() + portToWt + (long long)portToWm*n;
+	while (n > 0) {
+		int i = ::write(portHandle,p,n);
+		if (i > 0) {
+			if (tap) tap->record(SERTAP_OUT, p, i);
+			p += i;
+			n -= i;
+			continue;
+		}
+		if (i < 0 && errno != EAGAIN && errno != EINTR) return true;
+		int left = int(deadline - now_ms());
+		if (left <= 0) return true;
+		struct pollfd pfd;
+		pfd.fd = portHandle;
+		pfd.events = POLLOUT;
+		poll(&pfd, 1, left);
+	}
+	return false;
+}
+
+bool serialHandler::fill(int timeout) {
+	if (rpos < rlen) return false;
+	rpos = rlen = 0;
+	bool woken = false;
+	for (;;) {
+		int i = read(portHandle,rbuf,sizeof(rbuf));
+		if (i > 0) {
+#ifdef DUMP_BYTEINS
+			for (int k=0; k<i; ++k) {
+				std::cerr<<"Bytein: 0x"<<std::setw(2)<<std::setfill('0')<<std::hex<<unsigned(rbuf[k]);
+				if (std::isgraph(rbuf[k])) std::cerr<<", \'"<<rbuf[k]<<"\'";
+				std::cerr<<std::endl;
+			}
+#endif
+			rlen = i;
+			if (tap) tap->record(SERTAP_IN, rbuf, i);
+			return false;
+		}
+		// With VMIN 0 an empty port reads 0, as EAGAIN; after a wake it is a hangup
+		if (i == 0 && woken) return true;
+		if (i < 0 && errno != EAGAIN && errno != EINTR) return true;
+		
+		// Nothing yet, wait for it
+		struct epoll_event ev;
+		int n = epoll_wait(epollHandle, &ev, 1, timeout);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return true;
+		woken = true;
+	}
 }
 
 bool serialHandler::getch(char &ch) {
 	if (!Connected()) return true;
-	fd_set set;
-	FD_ZERO((&set));
-	FD_SET(portHandle,(&set));
-	timeval timeout;
-	timeout.tv_sec=0;
-	timeout.tv_usec=500000;
-	do {
-		int i=select(portHandle+1,&set,0,0,&timeout);
-		if (i<0) {
-			if (errno = EINTR) continue;
-			return true;
-		} else if (i==0) return true;
-	} while (false);
-	int i = read(portHandle,&ch,1);
-#ifdef DUMP_BYTEINS
-	if (i) {
-		std::cerr<<"Bytein: 0x"<<std::setw(2)<<std::setfill('0')<<std::hex<<unsigned(ch);
-		if (std::isgraph(ch)) std::cerr<<", \'"<<ch<<"\'";
-		std::cerr<<std::endl;
+	if (fill(500)) return true;
+	ch = rbuf[rpos++];
+	return false;
+}
+
+bool serialHandler::readLine(string &s, int timeout) {
+	s = "";
+	if (!Connected()) return true;
+	for (;;) {
+		if (fill(timeout)) return true;
+		char *b = rbuf + rpos, *e = rbuf + rlen;
+		char *nl = (char*)memchr(b, '\n', e-b);
+		char *end = nl ? nl : e;
+		for (char *c=b; c<end; ++c) if (*c != '\r') s += *c;
+		rpos = nl ? nl-rbuf+1 : rlen;
+		if (nl) return false;
+	}
+}
+
+int serialHandler::readLine(char *s, int size, int timeout) {
+	int n = 0;
+	s[0] = 0;
+	if (!Connected()) return -1;
+	for (;;) {
+		if (fill(timeout)) return -1;
+		char *b = rbuf + rpos, *e = rbuf + rlen;
+		char *nl = (char*)memchr(b, '\n', e-b);
+		char *end = nl ? nl : e;
+		for (char *c=b; c<end; ++c) if (*c != '\r' && n < size-1) s[n++] = *c;
+		s[n] = 0;
+		rpos = nl ? nl-rbuf+1 : rlen;
+		if (nl) return n;
 	}
-#endif
-	return !i;
 }
 //---------------------------------------------------------------------------
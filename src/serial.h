@@ -28,7 +28,9 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
 #include <string>
+#include "serial_tap.h"
 
 using std::string;
 #define INVALID_HANDLE_VALUE -1
@@ -56,6 +58,14 @@ class serialHandler {
 	int portToWm;
 	int portToWt;
 	bool lastRTS, lastDTR;
+	
+	// Nonblocking I/O, waited for with epoll, and read ahead into rbuf
+	int epollHandle;
+	char rbuf[512];
+	int rpos, rlen;
+	bool fill(int timeout); // Reads whatever is there, waiting up to timeout ms. True on timeout or error.
+	
+	sertap_port *tap;
 	public:
 	serialHandler();
 	bool Connected() const { return portHandle!=INVALID_HANDLE_VALUE; }
@@ -102,6 +112,15 @@ class serialHandler {
 		}
 		return true;
 	}
+	// Reads a line, without '\r' nor '\n', straight from the read-ahead
+	// buffer. Fails (true) after timeout ms with no bytes coming in.
+	bool readLine(string &s, int timeout=500);
+	// As above, into s[size], '\0' terminated. Returns the length, or -1 on
+	// timeout. The rest of a longer line is read and dropped.
+	int readLine(char *s, int size, int timeout=500);
+	int buffered() const { return rlen - rpos; }
+	// Records all bytes read and written to t, as channel, 0 to stop.
+	void setTap(serial_tap *t, int channel=0) { tap = t ? t->attach(channel) : 0; }
 	bool putch(char ch) { return write(&ch,1); }
 	bool putch(unsigned char ch) { return write((char*) &ch,1); }
 	void sendBreak() {
@@ -111,10 +130,12 @@ class serialHandler {
 	void flush() {
 		if (!Connected()) return;
 		tcflush(portHandle,TCIOFLUSH);
+		rpos = rlen = 0;
 	}
 	void flushRead() {
 		if (!Connected()) return;
 		tcflush(portHandle,TCIFLUSH);
+		rpos = rlen = 0;
 	}
 	void flushWrite() {
 		if (!Connected()) return;
@@ -0,0 +1,168 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#include "serial_tap.h"
+#include <cstring>
+#include <csignal>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+// The rings are drained this often, ms
+#define SERTAP_DRAIN_MS 50
+
+serial_tap::serial_tap() : f(0), opened(false), nports(0), nrecords(0), ndropped(0) {
+	pthread_mutex_init(&lock, 0);
+	wake[0] = wake[1] = -1;
+}
+
+serial_tap::~serial_tap() {
+	close();
+	for (int i=0; i<nports; ++i) delete port[i];
+	pthread_mutex_destroy(&lock);
+}
+
+bool serial_tap::open(const char *filename) {
+	close();
+	f = fopen(filename, "wb");
+	if (!f) return false;
+	if (fwrite(SERTAP_MAGIC, 8, 1, f) != 1 || pipe(wake)) {
+		fclose(f);
+		f = 0;
+		return false;
+	}
+	
+	// Anything recorded while closed is not wanted
+	for (int i=0; i<nports; ++i)
+		while (port[i]->ring.front()) port[i]->ring.pop();
+	nrecords = ndropped = 0;
+	
+	sigset_t mask, old;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old); // Signals are for the main thread
+	int e = pthread_create(&tid, 0, worker, this);
+	pthread_sigmask(SIG_SETMASK, &old, 0);
+	if (e) {
+		::close(wake[0]);
+		::close(wake[1]);
+		wake[0] = wake[1] = -1;
+		fclose(f);
+		f = 0;
+		return false;
+	}
+	opened = true;
+	return true;
+}
+
+void serial_tap::close() {
+	if (!opened) return;
+	opened = false;
+	char c = 0;
+	if (write(wake[1], &c, 1)) {}
+	pthread_join(tid, 0);
+	::close(wake[0]);
+	::close(wake[1]);
+	wake[0] = wake[1] = -1;
+	drain();
+	fclose(f);
+	f = 0;
+}
+
+sertap_port *serial_tap::attach(int channel) {
+	pthread_mutex_lock(&lock);
+	sertap_port *p = 0;
+	int n = nports.load(std::memory_order_relaxed);
+	if (n < SERTAP_PORTS) {
+		p = port[n] = new sertap_port(*this, channel);
+		nports.store(n+1, std::memory_order_release);
+	}
+	pthread_mutex_unlock(&lock);
+	return p;
+}
+
+uint64_t serial_tap::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+void sertap_port::record(int dir, const char *p, int n) {
+	if (!tap.opened.load(std::memory_order_relaxed) || n <= 0) return;
+	sertap_chunk c;
+	c.r.t = serial_tap::now();
+	c.r.dir = dir;
+	c.r.channel = channel;
+	for (; n > 0; n -= c.r.n, p += c.r.n) {
+		c.r.n = n > SERTAP_CHUNK ? SERTAP_CHUNK : n;
+		memcpy(c.data, p, c.r.n);
+		if (!ring.push(c)) ++tap.ndropped;
+	}
+}
+
+// Writes out every record in the rings, the oldest first.
+void serial_tap::drain() {
+	int n = nports.load(std::memory_order_acquire);
+	for (;;) {
+		sertap_port *next = 0;
+		const sertap_chunk *c = 0;
+		for (int i=0; i<n; ++i) {
+			const sertap_chunk *x = port[i]->ring.front();
+			if (x && (!c || x->r.t < c->r.t)) {
+				next = port[i];
+				c = x;
+			}
+		}
+		if (!c) break;
+		fwrite(&c->r.t, sizeof(c->r.t), 1, f);
+		fwrite(&c->r.n, sizeof(c->r.n), 1, f);
+		fwrite(&c->r.dir, 1, 1, f);
+		fwrite(&c->r.channel, 1, 1, f);
+		fwrite(c->data, 1, c->r.n, f);
+		next->ring.pop();
+		++nrecords;
+	}
+	fflush(f);
+}
+
+void *serial_tap::worker(void *self) {
+	serial_tap &t = *(serial_tap*)self;
+	for (;;) {
+		struct pollfd p;
+		p.fd = t.wake[0];
+		p.events = POLLIN;
+		if (poll(&p, 1, SERTAP_DRAIN_MS) > 0) break;
+		t.drain();
+	}
+	return 0;
+}
+
+bool serial_tap::check_magic(FILE *in) {
+	char m[8];
+	return fread(m, 8, 1, in) == 1 && !memcmp(m, SERTAP_MAGIC, 8);
+}
+
+bool serial_tap::read(FILE *in, sertap_record &r, char *data) {
+	return
+		fread(&r.t, sizeof(r.t), 1, in) == 1 &&
+		fread(&r.n, sizeof(r.n), 1, in) == 1 &&
+		fread(&r.dir, 1, 1, in) == 1 &&
+		fread(&r.channel, 1, 1, in) == 1 &&
+		fread(data, 1, r.n, in) == r.n;
+}
@@ -0,0 +1,121 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef SERIAL_TAP_H
+#define SERIAL_TAP_H
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+#include <pthread.h>
+#include "spsc_ring.h"
+
+// Transcript of the bytes on one or more serial ports, as seen by
+// serialHandler, for serreplay. A file is the magic "SERTAP1\n", then a
+// record per read() or write():
+//
+//   uint64_t t;        // CLOCK_MONOTONIC, ns
+//   uint16_t n;        // Bytes
+//   uint8_t  dir;      // SERTAP_IN or SERTAP_OUT
+//   uint8_t  channel;  // Set by the owner of the port
+//   char     data[n];
+//
+// in host byte order. Those longer than SERTAP_CHUNK bytes are split.
+#define SERTAP_MAGIC "SERTAP1\n"
+#define SERTAP_IN  0 // Read from the port
+#define SERTAP_OUT 1 // Written to the port
+
+#define SERTAP_CHUNK 512 // Longest record, a serialHandler read
+#define SERTAP_PORTS 8   // Most ports on one tap
+
+struct sertap_record {
+	uint64_t t;
+	uint16_t n;
+	uint8_t  dir;
+	uint8_t  channel;
+};
+
+struct sertap_chunk {
+	sertap_record r;
+	char data[SERTAP_CHUNK];
+};
+
+class serial_tap;
+
+// A port's way into a tap, from serial_tap::attach(). record() copies the
+// bytes into a lock-free ring, never blocking nor allocating, so it may be
+// called from the control thread; one thread at a time per port.
+class sertap_port {
+	friend class serial_tap;
+	serial_tap &tap;
+	uint8_t channel;
+	spsc_ring<sertap_chunk, 512> ring;
+	
+	sertap_port(serial_tap &t, int c) : tap(t), channel(c) {}
+	
+	public:
+	void record(int dir, const char *p, int n);
+};
+
+// Ports of several threads may share one tap. A thread of its own drains
+// their rings every 50ms, in time order, to the file; a slow disk only backs
+// the rings up, and records that find theirs full are dropped, and counted.
+class serial_tap {
+	friend class sertap_port;
+	FILE *f;
+	std::atomic<bool> opened;
+	pthread_mutex_t lock;       // Taken by attach()
+	sertap_port *port[SERTAP_PORTS];
+	std::atomic<int> nports;
+	std::atomic<long> nrecords, ndropped;
+	pthread_t tid;
+	int wake[2];                // Pipe, written to stop the thread
+	
+	static void *worker(void *self);
+	void drain();
+	
+	// Non-copyable
+	serial_tap(const serial_tap &);
+	serial_tap &operator=(const serial_tap &);
+	
+	public:
+	serial_tap();
+	~serial_tap();
+	
+	bool open(const char *filename); // False on failure
+	void close();                    // Writes out everything recorded so far
+	operator bool () const { return opened; }
+	
+	// Port recording as channel, 0 when out of ports. Lives as long as the
+	// tap.
+	sertap_port *attach(int channel);
+	
+	long records() const { return nrecords; } // Written out
+	long dropped() const { return ndropped; }
+	
+	static uint64_t now(); // ns
+	
+	// Reads the next record, and its n bytes into data[65536]. False at
+	// the end of the file. check_magic() reads the magic first.
+	static bool check_magic(FILE *in);
+	static bool read(FILE *in, sertap_record &r, char *data);
+};
+
+#endif
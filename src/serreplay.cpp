@@ -0,0 +1,257 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+/***************************************************************************
+ *   Serial transcript replayer: serves one port of a transcript recorded  *
+ *   with mppt --serial-log on a pseudo-terminal, as the device. Bytes the *
+ *   host writes are checked against the recorded ones, and the recorded  *
+ *   replies go back at their recorded delays, or as fast as possible.     *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include "arg_tool.h"
+#include "straux.h"
+#include "serial_tap.h"
+
+using namespace std;
+
+int iHelp, iTranscript, iChannel, iFast, iLink, iDump, iTimeout;
+arg_t args[] = {
+	{"-h",           &iHelp,       ARG_FLAG},
+	{"--help",       &iHelp,       ARG_FLAG},
+	{"--transcript", &iTranscript, ARG_DEFAULT},
+	{"--channel",    &iChannel,    ARG_DEFAULT},
+	{"--fast",       &iFast,       ARG_FLAG},
+	{"--link",       &iLink,       ARG_DEFAULT},
+	{"--dump",       &iDump,       ARG_FLAG},
+	{"--timeout",    &iTimeout,    ARG_DEFAULT},
+	{0,0,0}
+};
+
+struct record {
+	sertap_record r;
+	string data;
+};
+
+static volatile sig_atomic_t quit = 0;
+static void quit_handler(int) { quit = 1; }
+
+static double now() {
+	return 1e-9*serial_tap::now();
+}
+
+static void sleep_until(double t) {
+	struct timespec ts;
+	ts.tv_sec  = time_t(t);
+	ts.tv_nsec = long(1e9*(t - ts.tv_sec));
+	while (!quit && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR);
+}
+
+static void dump(const record &x, uint64_t t0) {
+	cout<<fixed<<setprecision(6)<<1e-9*(x.r.t - t0)<<" "<<int(x.r.channel)
+		<<(x.r.dir == SERTAP_OUT ? " > " : " < ");
+	for (size_t i=0; i<x.data.length(); ++i) {
+		unsigned char c = x.data[i];
+		if      (c == '\r') cout<<"\\r";
+		else if (c == '\n') cout<<"\\n";
+		else if (c == '\\') cout<<"\\\\";
+		else if (isprint(c)) cout<<c;
+		else cout<<"\\x"<<hex<<setw(2)<<setfill('0')<<unsigned(c)<<dec<<setfill(' ');
+	}
+	cout<<endl;
+}
+
+int main(int argc, const char *argv[]) {
+	if (arg_eval(argc, argv, args)) {
+		cerr<<"Error: Command line parsing failed."<<endl;
+		return 1;
+	}
+	if (iHelp || !iTranscript) {
+		cout<<"Usage: serreplay --transcript FILE [--channel N] [--fast] [--link PATH]"<<endl;
+		cout<<"                 [--timeout MS] [--dump]"<<endl;
+		cout<<"Serves channel N (the first one recorded) of a transcript written by"<<endl;
+		cout<<"mppt --serial-log on a pseudo-terminal, as the device: what the host"<<endl;
+		cout<<"writes is checked against the recording, and the recorded replies are"<<endl;
+		cout<<"sent at their recorded delay from the host bytes before them, or at"<<endl;
+		cout<<"once with --fast. Gives up after MS ms (5000) without the host writing."<<endl;
+		cout<<"--dump prints the transcript instead, times relative to the first record."<<endl;
+		return iHelp ? 0 : 1;
+	}
+	int channel = -1;
+	if (iChannel) {
+		channel = strIsInt(argv[iChannel]) ? atoi(argv[iChannel]) : -1;
+		if (channel < 0 || channel > 255) {
+			cerr<<"Error: --channel requires a channel number, 0 to 255."<<endl;
+			return 1;
+		}
+	}
+	int timeout = 5000;
+	if (iTimeout) timeout = strIsInt(argv[iTimeout]) ? atoi(argv[iTimeout]) : -1;
+	if (timeout <= 0) {
+		cerr<<"Error: --timeout requires a positive number of ms."<<endl;
+		return 1;
+	}
+	
+	// Transcript
+	FILE *in = fopen(argv[iTranscript], "rb");
+	if (!in || !serial_tap::check_magic(in)) {
+		cerr<<"Error: \""<<argv[iTranscript]<<"\" is not a serial transcript."<<endl;
+		return 1;
+	}
+	vector<record> recs;
+	vector<char> data(65536);
+	record x;
+	uint64_t t0 = 0;
+	while (serial_tap::read(in, x.r, &data[0])) {
+		if (!t0) t0 = x.r.t;
+		x.data.assign(&data[0], x.r.n);
+		if (iDump) {
+			if (channel < 0 || x.r.channel == channel) dump(x, t0);
+			continue;
+		}
+		if (channel < 0) channel = x.r.channel;
+		if (x.r.channel == channel) recs.push_back(x);
+	}
+	fclose(in);
+	if (iDump) return 0;
+	if (recs.empty()) {
+		cerr<<"Error: Nothing recorded on that channel."<<endl;
+		return 1;
+	}
+	
+	// Pseudo-terminal, as bopemu opens it
+	int port = posix_openpt(O_RDWR | O_NOCTTY);
+	if (port < 0 || grantpt(port) || unlockpt(port)) {
+		cerr<<"Error: Failed to open a pseudo-terminal: "<<strerror(errno)<<"."<<endl;
+		return 1;
+	}
+	string device = ptsname(port);
+	int slave = open(device.c_str(), O_RDWR | O_NOCTTY);
+	if (slave >= 0) {
+		struct termios t;
+		tcgetattr(slave, &t);
+		cfmakeraw(&t);
+		tcsetattr(slave, TCSANOW, &t);
+	}
+	if (iLink) {
+		unlink(argv[iLink]);
+		if (symlink(device.c_str(), argv[iLink])) {
+			cerr<<"Error: Failed to link "<<argv[iLink]<<": "<<strerror(errno)<<"."<<endl;
+			return 1;
+		}
+	}
+	
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = quit_handler;
+	sigaction(SIGINT,  &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+	
+	cout<<"<< Serial transcript replayer >>"<<endl;
+	cout<<"Channel "<<channel<<", "<<recs.size()<<" records, "<<1e-9*(recs.back().r.t - recs.front().r.t)<<"s."<<endl;
+	cout<<"Port "<<device<<"."<<endl;
+	
+	// Serve. Replies are timed from the host bytes before them.
+	long nout = 0, nin = 0, wrong = 0;
+	double anchor = now();         // When the last host bytes came in
+	uint64_t anchor_t = recs[0].r.t;
+	double turn = 0, turn_t = 0;   // Host turnaround, replayed and recorded
+	long turns = 0;
+	double replied = NAN;          // When the last reply went out
+	uint64_t replied_t = 0;
+	double first = NAN;
+	size_t k;
+	char buf[512];
+	bool stalled = false;
+	for (k=0; k<recs.size() && !quit && !stalled; ++k) {
+		const record &r = recs[k];
+		if (r.r.dir == SERTAP_OUT) {
+			// Wait for as many bytes from the host
+			for (int got=0; got<r.r.n && !quit; ) {
+				struct pollfd pfd;
+				pfd.fd = port;
+				pfd.events = POLLIN;
+				int p = poll(&pfd, 1, timeout);
+				if (p < 0) continue;
+				if (p == 0) {
+					stalled = true;
+					break;
+				}
+				int n = read(port, buf, min(int(sizeof(buf)), r.r.n - got));
+				if (n <= 0) continue;
+				for (int i=0; i<n; ++i) wrong += buf[i] != r.data[got+i];
+				got += n;
+			}
+			if (stalled || quit) break;
+			anchor = now();
+			anchor_t = r.r.t;
+			if (isnan(first)) first = anchor;
+			if (!isnan(replied)) {
+				turn   += anchor - replied;
+				turn_t += 1e-9*(r.r.t - replied_t);
+				++turns;
+				replied = NAN;
+			}
+			nout += r.r.n;
+		} else {
+			if (!iFast) sleep_until(anchor + 1e-9*(r.r.t - anchor_t));
+			for (int i=0; i<r.r.n && !quit; ) {
+				int w = write(port, r.data.data()+i, r.r.n-i);
+				if (w > 0) i += w;
+			}
+			replied = now();
+			replied_t = r.r.t;
+			if (isnan(first)) first = replied;
+			nin += r.r.n;
+		}
+	}
+	double last = now();
+	
+	if (iLink) unlink(argv[iLink]);
+	if (slave >= 0) close(slave);
+	close(port);
+	
+	if (stalled) cout<<"The host stopped writing at record "<<k<<" of "<<recs.size()<<"."<<endl;
+	cout<<"Replayed "<<k<<" records, "<<nout<<" bytes from the host ("<<wrong<<" differing), "
+		<<nin<<" to it, in "<<(isnan(first) ? 0 : last - first)<<"s."<<endl;
+	if (turns) cout<<"Host turnaround, reply to next command: "<<1e3*turn/turns<<"ms, recorded "
+		<<1e3*turn_t/turns<<"ms, mean of "<<turns<<"."<<endl;
+	return stalled || wrong ? 2 : 0;
+}
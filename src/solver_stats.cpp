@@ -0,0 +1,174 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "solver_stats.h"
+
+#ifdef SOLVER_STATS
+#include <iomanip>
+#include <cstring>
+#include <pthread.h>
+
+using namespace std;
+
+static const char *solver_names[SOLVER_COUNT] = {
+	"pvGenerator::V",
+	"pvGenerator::I",
+	"pvGenerator_mc::I",
+	"pvgen_mpp_I",
+	"MLAM map node"
+};
+
+struct solver_counters {
+	long calls, failed, thrown, iterations;
+	int maxit;
+	timestamp cycles, maxcycles;
+	long hist[SOLVER_BUCKETS];
+	
+	void add(const solver_counters &o) {
+		calls      += o.calls;
+		failed     += o.failed;
+		thrown     += o.thrown;
+		iterations += o.iterations;
+		cycles     += o.cycles;
+		if (o.maxit     > maxit)     maxit     = o.maxit;
+		if (o.maxcycles > maxcycles) maxcycles = o.maxcycles;
+		for (int b=0; b<SOLVER_BUCKETS; ++b) hist[b] += o.hist[b];
+	}
+};
+
+struct solver_table {
+	solver_counters c[SOLVER_COUNT][SOLVER_MAX_SITES];
+	solver_table() { memset(c, 0, sizeof(c)); }
+	~solver_table();
+	void mergeInto(solver_table &t);
+};
+
+// Site 0 is "other". Names are registered once per SOLVER_SITE, through a
+// function static, and never removed.
+static const char *site_names[SOLVER_MAX_SITES] = { "other" };
+static int sites = 1;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static solver_table totals;
+
+static thread_local solver_table local;
+static thread_local int current_site = 0;
+static thread_local solver_sample last[SOLVER_COUNT];
+
+solver_table::~solver_table() {
+	if (this == &totals) return;
+	pthread_mutex_lock(&lock);
+	mergeInto(totals);
+	pthread_mutex_unlock(&lock);
+}
+
+void solver_table::mergeInto(solver_table &t) {
+	for (int s=0; s<SOLVER_COUNT; ++s) for (int k=0; k<SOLVER_MAX_SITES; ++k) {
+		if (!c[s][k].calls) continue;
+		t.c[s][k].add(c[s][k]);
+		memset(&c[s][k], 0, sizeof(c[s][k]));
+	}
+}
+
+int solver_site_register(const char *name) {
+	pthread_mutex_lock(&lock);
+	int id = 0;
+	for (int k=1; k<sites; ++k) if (!strcmp(site_names[k], name)) id = k;
+	if (!id && sites < SOLVER_MAX_SITES) {
+		id = sites++;
+		site_names[id] = name;
+	}
+	pthread_mutex_unlock(&lock);
+	return id;
+}
+
+int solver_site_enter(int site) {
+	int previous = current_site;
+	current_site = site;
+	return previous;
+}
+
+void solver_site_leave(int previous) {
+	current_site = previous;
+}
+
+// Iteration count histogram bucket: 0 to 15 exact, then [16,32), [32,64)...
+static int bucket(int n) {
+	if (n < 16) return n < 0 ? 0 : n;
+	int b = 16;
+	for (n >>= 5; n && b < SOLVER_BUCKETS-1; n >>= 1) ++b;
+	return b;
+}
+
+void solver_record(int solver, int iterations, bool converged, bool thrown, timestamp cycles) {
+	solver_sample &l = last[solver];
+	l.iterations = thrown ? -1 : iterations;
+	l.converged  = converged && !thrown;
+	l.thrown     = thrown;
+	l.cycles     = cycles;
+	
+	solver_counters &c = local.c[solver][current_site];
+	++c.calls;
+	c.cycles += cycles;
+	if (cycles > c.maxcycles) c.maxcycles = cycles;
+	if (thrown) {
+		++c.thrown;
+		return;
+	}
+	if (!converged) ++c.failed;
+	c.iterations += iterations;
+	if (iterations > c.maxit) c.maxit = iterations;
+	++c.hist[bucket(iterations)];
+}
+
+solver_sample solver_last(int solver) {
+	return last[solver];
+}
+
+void solver_stats_report(ostream &out) {
+	pthread_mutex_lock(&lock);
+	local.mergeInto(totals);
+	
+	double ns = 1e9/cpu_clock();
+	out<<"Solver statistics:"<<endl;
+	for (int s=0; s<SOLVER_COUNT; ++s) for (int k=0; k<sites; ++k) {
+		const solver_counters &c = totals.c[s][k];
+		if (!c.calls) continue;
+		long ended = c.calls - c.thrown;
+		out<<"  "<<solver_names[s]<<" @ "<<site_names[k]<<": "<<c.calls<<" calls, ";
+		out<<(ended ? double(c.iterations)/ended : 0.)<<" iterations (max "<<c.maxit<<"), ";
+		out<<c.failed<<" failed, "<<c.thrown<<" thrown, ";
+		out<<c.cycles*ns/c.calls<<" ns/call (max "<<c.maxcycles*ns<<")"<<endl;
+		
+		out<<"    iterations:";
+		for (int b=0; b<SOLVER_BUCKETS; ++b) {
+			if (!c.hist[b]) continue;
+			if (b < 16) out<<" "<<b;
+			else        out<<" "<<(1<<(b-12))<<"+";
+			out<<":"<<c.hist[b];
+		}
+		out<<endl;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+#endif
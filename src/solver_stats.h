@@ -0,0 +1,107 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SOLVER_STATS_H
+#define SOLVER_STATS_H
+
+// Solver instrumentation, built in with -DSOLVER_STATS (cmake
+// -DMPPT_SOLVER_STATS=ON), and expanding to nothing otherwise.
+//
+// Solvers wrap each call in SOLVER_CALL()/SOLVER_DONE(), which count calls,
+// iterations (as a histogram), failures to converge, exceptions leaving the
+// solver and TSC time. Counts are kept per call site: the innermost
+// SOLVER_SITE() scope, or SOLVER_AT() statement, of the calling thread, and
+// "other" outside any. Counters
+// are thread local, merged into the totals when their thread exits and when
+// a report is printed, so solvers never contend for them.
+
+#include <iostream>
+
+enum solver_id {
+	SOLVER_PVGEN_V,    // pvGenerator::V, Newton (or secant) on one cell or module
+	SOLVER_PVGEN_I,    // pvGenerator::I, Newton
+	SOLVER_PVGEN_MC_I, // pvGenerator_mc::I, descending step over the string
+	SOLVER_MPP_I,      // pvgen_mpp_I, bisection
+	SOLVER_MLAM_MAP,   // MLAM map nodes, Newton
+	SOLVER_COUNT
+};
+
+#ifdef SOLVER_STATS
+#include "rdtsc.h"
+
+#define SOLVER_MAX_SITES 32 // Later ones count as "other"
+#define SOLVER_BUCKETS   24 // 0..15 iterations, then powers of two up to 2048+
+
+extern int  solver_site_register(const char *name);
+extern int  solver_site_enter(int site); // Returns the previous site
+extern void solver_site_leave(int previous);
+extern void solver_record(int solver, int iterations, bool converged, bool thrown, timestamp cycles);
+
+// Last call of a solver on the calling thread, for tools that map solvers
+// point by point, as atlas. Calls left by an exception have iterations -1.
+struct solver_sample {
+	int iterations;
+	bool converged, thrown;
+	timestamp cycles;
+};
+extern solver_sample solver_last(int solver);
+
+// Prints the totals, after merging the counters of the calling thread.
+extern void solver_stats_report(std::ostream &out);
+
+struct solver_site_scope {
+	int previous;
+	solver_site_scope(int site) : previous(solver_site_enter(site)) {}
+	~solver_site_scope() { solver_site_leave(previous); }
+};
+
+// One solver call. Calls never marked done left by an exception.
+struct solver_call {
+	int solver;
+	bool done;
+	timestamp t0;
+	solver_call(int s) : solver(s), done(false), t0(read_timestamp_counter()) {}
+	~solver_call() {
+		if (!done) solver_record(solver, -1, false, true, read_timestamp_counter() - t0);
+	}
+	void finish(int iterations, bool converged) {
+		done = true;
+		solver_record(solver, iterations, converged, false, read_timestamp_counter() - t0);
+	}
+};
+
+#define SOLVER_CALL(id)          solver_call solver_call_(id)
+#define SOLVER_DONE(n, ok)       solver_call_.finish((n), (ok))
+#define SOLVER_SITE(name) \
+	static const int solver_site_id_ = solver_site_register(name); \
+	solver_site_scope solver_site_(solver_site_id_)
+#define SOLVER_AT(name, ...)     do { SOLVER_SITE(name); __VA_ARGS__; } while (0)
+#define SOLVER_STATS_REPORT(out) solver_stats_report(out)
+
+#else
+
+#define SOLVER_CALL(id)          do {} while (0)
+#define SOLVER_DONE(n, ok)       do {} while (0)
+#define SOLVER_SITE(name)        do {} while (0)
+#define SOLVER_AT(name, ...)     do { __VA_ARGS__; } while (0)
+#define SOLVER_STATS_REPORT(out) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free ring of N (a power of two) items, for one producer thread and
+// one consumer thread. push() and pop() never block nor allocate: push()
+// fails when the ring is full, pop() when it is empty.
+template <typename T, size_t N>
+class spsc_ring {
+	static_assert(N && !(N & (N-1)), "spsc_ring size must be a power of two");
+	
+	T item[N];
+	alignas(64) std::atomic<size_t> head; // Next to pop, consumer only
+	alignas(64) std::atomic<size_t> tail; // Next to push, producer only
+	
+	public:
+	spsc_ring() : head(0), tail(0) {}
+	
+	// Producer
+	bool push(const T &x) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N) return false;
+		item[t & (N-1)] = x;
+		tail.store(t+1, std::memory_order_release);
+		return true;
+	}
+	
+	// Consumer
+	bool pop(T &x) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		x = item[h & (N-1)];
+		head.store(h+1, std::memory_order_release);
+		return true;
+	}
+	
+	// Consumer, in place: front() is the next item, or 0 when empty, valid
+	// until pop() drops it.
+	const T *front() const {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return 0;
+		return &item[h & (N-1)];
+	}
+	void pop() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+	static size_t capacity() { return N; }
+};
+
+#endif
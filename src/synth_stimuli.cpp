@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <cmath>
+#include "synth_stimuli.h"
+
+static const double latitude = -7.2*M_PI/180;
+
+// xorshift64, seeded per day so any day can be generated alone.
+struct synth_rand {
+	unsigned long long x;
+	synth_rand(unsigned long long seed) : x(seed*0x9E3779B97F4A7C15ull + 88172645463325252ull) {}
+	double operator () () { // Uniform in [0,1)
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		return (x >> 11) * (1.0/9007199254740992.0);
+	}
+};
+
+void synth_day(int day, std::vector<double> &Time, std::vector<double> &G, std::vector<double> &T) {
+	Time.clear();
+	G.clear();
+	T.clear();
+	synth_rand rnd(day);
+	
+	// Sun declination, and how cloudy the day is. Clouds pass in one
+	// minute blocks, and their edges are smoothed over 10s.
+	double decl = 23.45*M_PI/180 * sin(2*M_PI*(284+day+1)/365);
+	double cloudiness = rnd();
+	cloudiness *= cloudiness;
+	double shade = 1, cover = 1;
+	
+	// Ambient temperature, Celsius: seasonal and daily swings. Cells
+	// heat up 0.034 K per W/m² (NOCT 47C), with a 5 minute time constant.
+	double Tseason = 26 + 2*cos(2*M_PI*(day-45)/365);
+	double Tc = Tseason - 3;
+	
+	for (int s=0; s<SYNTH_DAY_STEPS; ++s) {
+		double h = s/3600.;
+		double w = (h-12)*M_PI/12;
+		double sinel = sin(latitude)*sin(decl) + cos(latitude)*cos(decl)*cos(w);
+		double Gclear = sinel > 0 ? 1000*pow(sinel, 1.15) : 0;
+		
+		if (s % 60 == 0) cover = rnd() < cloudiness ? 0.2 + 0.4*rnd() : 1;
+		shade += (cover - shade)/10;
+		
+		double Ta = Tseason + 4*sin(2*M_PI*(h-9)/24);
+		Tc += (Ta + 0.034*Gclear*shade - Tc)/300;
+		
+		if (Gclear < SYNTH_MIN_G) continue; // Night
+		Time.push_back(day*double(SYNTH_DAY_STEPS) + s);
+		G.push_back(Gclear*shade);
+		T.push_back(Tc);
+	}
+}
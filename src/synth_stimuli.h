@@ -0,0 +1,41 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Lucas V. Hartmann <lucas.hartmann@gmail.com>    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SYNTH_STIMULI_H
+#define SYNTH_STIMULI_H
+
+#include <vector>
+
+// Seconds per synthetic day.
+#define SYNTH_DAY_STEPS 86400
+
+// Clear sky insolation at which converters start up, W/m². Trackers do not
+// get any sensible readings below.
+#define SYNTH_MIN_G 50
+
+// Canonical synthetic year, for benchmarks: clear sky insolation at 7.2S
+// with passing clouds, and cell temperature following ambient and
+// insolation. Every build and machine generates the very same numbers, one
+// day at a time so a year needs no more memory than a day. Only daylight is
+// sampled, one sample per second while the clear sky insolation is above
+// SYNTH_MIN_G. Day is 0 to 364, Time is seconds since the start of the year,
+// G in W/m² and T in Celsius.
+extern void synth_day(int day, std::vector<double> &Time, std::vector<double> &G, std::vector<double> &T);
+
+#endif